@@ -0,0 +1,517 @@
+/*
+ * FILE: rdt_bench.cc
+ * DESCRIPTION: Microbenchmarks of the protocol hot paths, plus a fixed-seed
+ *     end-to-end run of rdt_sim, with the results written as JSON so they
+ *     can be compared across versions.
+ * NOTE: Every microbenchmark is run a few times and the fastest run is
+ *       reported, which is the least disturbed by the rest of the machine.
+ *       The endpoint benchmarks talk to an endpoint through its env like
+ *       rdt_sim does, but the lower layer is a plain array: packets are
+ *       captured on the way down and acks are made up on the way up.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/wait.h>
+
+#include <vector>
+
+#include "rdt_struct.h"
+#include "rdt_common.h"
+#include "rdt_endpoint.h"
+#include "rdt_event.h"
+
+static const int bench_runs = 5;
+
+/* the end-to-end scenario, fixed so that runs of different versions
+   do the same work */
+static const char *sim_args = "-s 1 -f 16 200 0.1 100 0.15 0.15 0.15 0";
+
+/* the clock of the endpoints, which never runs in the microbenchmarks */
+double GetSimulationTime()
+{
+    return 0;
+}
+
+static double now_s()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* xorshift, so that the workload does not depend on the libc rand() */
+static unsigned int bench_rng = 2463534242u;
+
+static unsigned int rng_next()
+{
+    bench_rng ^= bench_rng << 13;
+    bench_rng ^= bench_rng >> 17;
+    bench_rng ^= bench_rng << 5;
+    return bench_rng;
+}
+
+/* fake lower and upper layers */
+static std::vector<packet> wire;            // packets passed down
+static unsigned long long acks_down;        // bare acks passed down by the receiver
+static unsigned long long bytes_up;         // payload passed up
+
+static void capture_to_lower(packet **pkts, int n)
+{
+    for (int i = 0; i < n; ++i) {
+        wire.push_back(*pkts[i]);
+    }
+}
+
+static void count_to_lower(packet **, int n)
+{
+    acks_down += n;
+}
+
+static void count_to_upper(unsigned int, message *msg)
+{
+    bytes_up += msg->size;
+}
+
+static void no_timer(unsigned int, double)
+{
+}
+
+static void no_stop_timer(unsigned int)
+{
+}
+
+
+/*[]------------------------------------------------------------------------[]
+  |  crc32 of a packet
+  []------------------------------------------------------------------------[]*/
+
+struct crc_result {
+    double ns_per_op;
+    double mb_per_s;
+};
+
+static crc_result bench_crc32()
+{
+    const int ops = 200000;
+    packet pkt;
+    for (int i = 0; i < RDT_PKTSIZE; ++i) {
+        pkt.data[i] = rng_next();
+    }
+
+    double best = 1e30;
+    volatile unsigned int sink = 0;
+    for (int r = 0; r < bench_runs; ++r) {
+        double t = now_s();
+        for (int i = 0; i < ops; ++i) {
+            pkt.data[4] = i;
+            sink = sink + crc32(pkt.data + 4, RDT_PKTSIZE - 4);
+        }
+        t = now_s() - t;
+        if (t < best) best = t;
+    }
+
+    crc_result res;
+    res.ns_per_op = best / ops * 1e9;
+    res.mb_per_s = (double)ops * (RDT_PKTSIZE - 4) / best / 1e6;
+    return res;
+}
+
+
+/*[]------------------------------------------------------------------------[]
+  |  segmentation of messages into packets at the sending endpoint
+  []------------------------------------------------------------------------[]*/
+
+struct segment_result {
+    unsigned long long packets;
+    double ns_per_packet;
+    double ns_per_byte;
+    double ack_ns_per_packet;   // of ns_per_packet, spent taking in the acks
+};
+
+static const int bench_msgs = 20000;
+static const int max_msg = 1000;
+static char msg_data[max_msg];
+
+/* the sizes of bench_msgs messages of 1 to max_msg bytes, returns their
+   total */
+static unsigned long long make_sizes(std::vector<int> &sizes)
+{
+    unsigned long long bytes = 0;
+    sizes.resize(bench_msgs);
+    for (int i = 0; i < bench_msgs; ++i) {
+        sizes[i] = 1 + rng_next() % max_msg;
+        bytes += sizes[i];
+    }
+    for (int i = 0; i < max_msg; ++i) {
+        msg_data[i] = 'a' + i % 26;
+    }
+    return bytes;
+}
+
+/* bare acks of flow 0, acks[s] acking seq s, made ahead so that their
+   CRCs are not part of the measured time */
+static std::vector<packet> acks;
+
+static void make_acks(unsigned long long bytes)
+{
+    unsigned int n = bytes / (RDT_PKTSIZE - header_size) + bench_msgs + 1;
+    if (acks.size() >= n) {
+        return;
+    }
+    acks.resize(n);
+    for (unsigned int s = 0; s < n; ++s) {
+        packet *ack = &acks[s];
+        memset(ack, 0, sizeof(packet));
+        PKT_FLOW(ack) = 0;
+        PKT_ACK(ack) = s;
+        PKT_CRC(ack) = crc32(ack->data + 4, RDT_PKTSIZE - 4);
+    }
+}
+
+/* pass messages to a sending endpoint, each packet being acked as soon
+   as it is on the wire so the window never stalls.  returns the number
+   of acks passed up */
+static unsigned int send_messages(endpoint *ep, const std::vector<int> &sizes)
+{
+    unsigned int n_acks = 0;
+    size_t acked = wire.size();
+    for (size_t i = 0; i < sizes.size(); ++i) {
+        message m;
+        m.size = sizes[i];
+        m.data = msg_data;
+        endpoint_from_upper(ep, 0, &m);
+        while (acked < wire.size()) {
+            acked = wire.size();
+            endpoint_from_lower(ep, &acks[PKT_SEQ(&wire.back())]);
+            ++n_acks;
+        }
+    }
+    return n_acks;
+}
+
+static const endpoint_env sender_env = {0, capture_to_lower, count_to_upper, no_timer, no_stop_timer};
+
+/* segment messages of 1 to max_msg bytes into packets.  the acks that
+   keep the window open cost the endpoint a CRC check each, which is
+   measured apart by passing the same acks to an endpoint with nothing
+   in flight */
+static segment_result bench_segment()
+{
+    std::vector<int> sizes;
+    unsigned long long bytes = make_sizes(sizes);
+    make_acks(bytes);
+
+    double best = 1e30;
+    unsigned int n_acks = 0;
+    for (int r = 0; r < bench_runs; ++r) {
+        wire.clear();
+        wire.reserve(bytes / (RDT_PKTSIZE - header_size) + bench_msgs);
+        endpoint *ep = endpoint_create(&sender_env, 1);
+
+        double t = now_s();
+        n_acks = send_messages(ep, sizes);
+        t = now_s() - t;
+        if (t < best) best = t;
+
+        endpoint_destroy(ep);
+    }
+
+    double best_acks = 1e30;
+    for (int r = 0; r < bench_runs; ++r) {
+        endpoint *ep = endpoint_create(&sender_env, 1);
+
+        double t = now_s();
+        for (unsigned int i = 1; i <= n_acks; ++i) {
+            endpoint_from_lower(ep, &acks[i]);
+        }
+        t = now_s() - t;
+        if (t < best_acks) best_acks = t;
+
+        endpoint_destroy(ep);
+    }
+
+    segment_result res;
+    res.packets = wire.size();
+    res.ns_per_packet = best / wire.size() * 1e9;
+    res.ns_per_byte = best / bytes * 1e9;
+    res.ack_ns_per_packet = best_acks / wire.size() * 1e9;
+    return res;
+}
+
+
+/*[]------------------------------------------------------------------------[]
+  |  reorder buffering and delivery at the receiving endpoint
+  []------------------------------------------------------------------------[]*/
+
+/* replay the packets a sending endpoint made of bench_msgs messages into
+   a receiving endpoint, either in order or with every window reversed,
+   so that all but the last packet of a window wait in the reorder
+   buffer.  returns ns per packet */
+static double bench_reorder(bool reversed)
+{
+    std::vector<int> sizes;
+    make_acks(make_sizes(sizes));
+    wire.clear();
+    endpoint *sender = endpoint_create(&sender_env, 1);
+    send_messages(sender, sizes);
+    endpoint_destroy(sender);
+    std::vector<packet> stream;
+    stream.swap(wire);
+
+    unsigned long long expect_bytes = 0;
+    std::vector<size_t> order;
+    order.reserve(stream.size());
+    for (size_t b = 0; b < stream.size(); b += window_size) {
+        size_t e = b + window_size < stream.size() ? b + window_size : stream.size();
+        for (size_t i = b; i < e; ++i) {
+            order.push_back(reversed ? e - 1 - (i - b) : i);
+            expect_bytes += PKT_SIZE(&stream[i]);
+        }
+    }
+
+    endpoint_env env = {1, count_to_lower, count_to_upper, no_timer, no_stop_timer};
+    double best = 1e30;
+    for (int r = 0; r < bench_runs; ++r) {
+        endpoint *ep = endpoint_create(&env, 1);
+        bytes_up = 0;
+
+        double t = now_s();
+        for (size_t i = 0; i < order.size(); ++i) {
+            packet pkt = stream[order[i]];
+            endpoint_from_lower(ep, &pkt);
+        }
+        t = now_s() - t;
+        if (t < best) best = t;
+
+        endpoint_destroy(ep);
+        ASSERT(bytes_up == expect_bytes);
+    }
+
+    return best / order.size() * 1e9;
+}
+
+
+/*[]------------------------------------------------------------------------[]
+  |  event chain operations at a given queue depth
+  []------------------------------------------------------------------------[]*/
+
+struct chain_result {
+    unsigned int depth;
+    double reschedule_ns;   // cancel a pending event and schedule it again
+    double hold_ns;         // take the next event and schedule it again
+};
+
+/* a uniform delay in [0, 1) seconds */
+static double rand_delay()
+{
+    return (rng_next() >> 8) / (double)(1 << 24);
+}
+
+/* the chain keeps depth events pending throughout: a timer restart
+   cancels one and schedules it again, an event occurring takes the
+   next one and schedules a follow-up */
+static chain_result bench_chain(unsigned int depth)
+{
+    const int ops = 200000;
+    std::vector<Event> events(depth);
+    std::vector<unsigned int> picks(ops);
+    for (int i = 0; i < ops; ++i) {
+        picks[i] = rng_next() % depth;
+    }
+
+    chain_result res;
+    res.depth = depth;
+    res.reschedule_ns = 1e30;
+    res.hold_ns = 1e30;
+    for (int r = 0; r < bench_runs; ++r) {
+        EventChain chain;
+        for (unsigned int i = 0; i < depth; ++i) {
+            events[i].sched_time = rand_delay();
+            chain.schedule(&events[i]);
+        }
+
+        double t = now_s();
+        for (int i = 0; i < ops; ++i) {
+            Event *e = &events[picks[i]];
+            chain.cancel(e);
+            e->sched_time = chain.time() + rand_delay();
+            chain.schedule(e);
+        }
+        t = now_s() - t;
+        if (t / ops * 1e9 < res.reschedule_ns) res.reschedule_ns = t / ops * 1e9;
+
+        t = now_s();
+        for (int i = 0; i < ops; ++i) {
+            Event *e = chain.next_event();
+            e->sched_time = chain.time() + rand_delay();
+            chain.schedule(e);
+        }
+        t = now_s() - t;
+        if (t / ops * 1e9 < res.hold_ns) res.hold_ns = t / ops * 1e9;
+        ASSERT(chain.heap.size() == depth);
+    }
+    return res;
+}
+
+
+/*[]------------------------------------------------------------------------[]
+  |  end-to-end run of rdt_sim
+  []------------------------------------------------------------------------[]*/
+
+struct sim_result {
+    bool ok;
+    double wall_s;
+    double elapsed_s;
+    unsigned long long bytes_delivered;
+    unsigned long long packets;
+};
+
+/* the number following "key": in a JSON text, 0 if not found */
+static double json_number(const char *text, const char *key)
+{
+    char pat[64];
+    snprintf(pat, sizeof(pat), "\"%s\":", key);
+    const char *p = strstr(text, pat);
+    return p != NULL ? atof(p + strlen(pat)) : 0;
+}
+
+static sim_result bench_sim(const char *sim_path)
+{
+    sim_result res;
+    memset(&res, 0, sizeof(res));
+
+    char json_path[] = "/tmp/rdt_bench.XXXXXX";
+    int fd = mkstemp(json_path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return res;
+    }
+    close(fd);
+
+    /* the enter rdt_sim waits for comes from echo */
+    char cmd[1024];
+    snprintf(cmd, sizeof(cmd), "echo | %s -j %s %s > /dev/null", sim_path, json_path, sim_args);
+    double t = now_s();
+    int status = system(cmd);
+    res.wall_s = now_s() - t;
+
+    char text[4096];
+    size_t len = 0;
+    FILE *f = fopen(json_path, "r");
+    if (f != NULL) {
+        len = fread(text, 1, sizeof(text) - 1, f);
+        fclose(f);
+    }
+    text[len] = '\0';
+    unlink(json_path);
+
+    if (status == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0 || len == 0) {
+        fprintf(stderr, "%s failed\n", sim_path);
+        return res;
+    }
+    res.ok = true;
+    res.elapsed_s = json_number(text, "elapsed_s");
+    res.bytes_delivered = json_number(text, "bytes_delivered");
+    res.packets = json_number(text, "data_pkts") + json_number(text, "ack_pkts");
+    return res;
+}
+
+
+/*[]------------------------------------------------------------------------[]
+  |  main benchmark control routine
+  []------------------------------------------------------------------------[]*/
+
+int main(int argc, char *argv[])
+{
+    const char *out_path = NULL;
+    const char *sim_path = NULL;
+    const char *version = "";
+    int opt;
+    while ((opt = getopt(argc, argv, "e:o:v:")) != -1) {
+        switch (opt) {
+        case 'e':
+            sim_path = optarg;
+            break;
+        case 'o':
+            out_path = optarg;
+            break;
+        case 'v':
+            version = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-e <rdt_sim>] [-o <results_json>] [-v <version>]\n", argv[0]);
+            exit(-1);
+        }
+    }
+
+    const unsigned int depths[] = {100, 1000, 10000, 100000};
+    const int n_depths = sizeof(depths) / sizeof(depths[0]);
+
+    crc_result crc = bench_crc32();
+    printf("crc32 (%d bytes): %.1f ns, %.1f MB/s\n", RDT_PKTSIZE - 4, crc.ns_per_op, crc.mb_per_s);
+
+    segment_result seg = bench_segment();
+    printf("segmentation: %.1f ns/packet (%.1f of them taking in acks), %.2f ns/byte over %llu packets\n",
+           seg.ns_per_packet, seg.ack_ns_per_packet, seg.ns_per_byte, seg.packets);
+
+    double in_order_ns = bench_reorder(false);
+    double reversed_ns = bench_reorder(true);
+    printf("delivery: %.1f ns/packet in order, %.1f ns/packet with reversed windows\n",
+           in_order_ns, reversed_ns);
+
+    chain_result chain[n_depths];
+    for (int i = 0; i < n_depths; ++i) {
+        chain[i] = bench_chain(depths[i]);
+        printf("event chain depth %u: reschedule %.1f ns, hold %.1f ns\n",
+               chain[i].depth, chain[i].reschedule_ns, chain[i].hold_ns);
+    }
+
+    sim_result sim;
+    memset(&sim, 0, sizeof(sim));
+    if (sim_path != NULL) {
+        sim = bench_sim(sim_path);
+        if (sim.ok) {
+            printf("rdt_sim %s: %.3f s, %.0f packets/s\n", sim_args, sim.wall_s, sim.packets / sim.wall_s);
+        }
+    }
+
+    FILE *out = stdout;
+    if (out_path != NULL) {
+        out = fopen(out_path, "w");
+        if (out == NULL) {
+            perror(out_path);
+            exit(-1);
+        }
+    }
+    fprintf(out, "{\n"
+            "  \"version\": \"%s\",\n"
+            "  \"crc32\": {\"bytes\": %d, \"ns_per_op\": %.3f, \"MB_per_s\": %.3f},\n"
+            "  \"segmentation\": {\"packets\": %llu, \"ns_per_packet\": %.3f, \"ns_per_byte\": %.3f, "
+            "\"ack_ns_per_packet\": %.3f},\n"
+            "  \"delivery\": {\"in_order_ns_per_packet\": %.3f, \"reversed_ns_per_packet\": %.3f},\n"
+            "  \"event_chain\": [",
+            version, RDT_PKTSIZE - 4, crc.ns_per_op, crc.mb_per_s,
+            seg.packets, seg.ns_per_packet, seg.ns_per_byte, seg.ack_ns_per_packet, in_order_ns, reversed_ns);
+    for (int i = 0; i < n_depths; ++i) {
+        fprintf(out, "%s\n    {\"depth\": %u, \"reschedule_ns\": %.3f, \"hold_ns\": %.3f}",
+                i ? "," : "", chain[i].depth, chain[i].reschedule_ns, chain[i].hold_ns);
+    }
+    fprintf(out, "\n  ]");
+    if (sim.ok) {
+        fprintf(out, ",\n"
+                "  \"rdt_sim\": {\"args\": \"%s\", \"wall_s\": %.6f, \"sim_elapsed_s\": %.6f, "
+                "\"packets\": %llu, \"bytes_delivered\": %llu, \"packets_per_s\": %.3f, "
+                "\"bytes_per_s\": %.3f}",
+                sim_args, sim.wall_s, sim.elapsed_s, sim.packets, sim.bytes_delivered,
+                sim.packets / sim.wall_s, sim.bytes_delivered / sim.wall_s);
+    }
+    fprintf(out, "\n}\n");
+    if (out != stdout) fclose(out);
+
+    return sim_path != NULL && !sim.ok ? 1 : 0;
+}
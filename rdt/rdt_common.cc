@@ -12,7 +12,7 @@ const unsigned int crc32_magic = 0x04C11DB7;
 unsigned int crc32(char *data, unsigned int len)
 {
     unsigned char byte;
-    unsigned int res, mask;
+    unsigned int res = 0xFFFFFFFF, mask;
     for (unsigned int i = 0; i < len; ++i) {
         byte = data[i];
         res = res ^ byte;
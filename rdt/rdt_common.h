@@ -8,9 +8,16 @@
 #ifndef _RDT_COMMON_H_
 #define _RDT_COMMON_H_
 
-const unsigned int header_size = 9;
+const unsigned int header_size = 18;
 const unsigned int window_size = 7;
 const double timeout = 0.3;
+const double ack_delay = 0.02;      // longest an ack waits for data to ride on
 unsigned int crc32(char *data, unsigned int len);
 
+/* sequence number comparison that survives the 32-bit wrap around */
+inline bool seq_before_eq(unsigned int a, unsigned int b)
+{
+    return (int)(a - b) <= 0;
+}
+
 #endif /* _RDT_COMMON_H_ */
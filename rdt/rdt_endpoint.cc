@@ -0,0 +1,486 @@
+/*
+ * FILE: rdt_endpoint.cc
+ * DESCRIPTION: Reliable data transfer endpoint.
+ * NOTE: Each flow sends with a sliding window and receives with selective
+ *       repeat.  A packet is resent when its timeout expires, or at once
+ *       when the selective acks show that dup_thresh later packets got
+ *       through while it did not.  Acks ride on the data packets going
+ *       the other way; an ack that finds no data to ride on is sent bare,
+ *       right away when a packet arrived out of order or every second
+ *       packet, otherwise after ack_delay.  The retransmission timeouts
+ *       and the ack delay of a flow share its one timer, which is set
+ *       for the earliest deadline.
+ *       Once the upper layer of a flow is done and its last messages are
+ *       in flight, the flow is in its tail: no new packets will come to
+ *       push the selective acks past dup_thresh, so a single later packet
+ *       acked is taken as a loss (early retransmit), and a packet resent
+ *       on timeout is sent twice, since losing it again costs another
+ *       timeout.  The extra copies trade wire bytes for a shorter drain.
+ *       The CRC of a packet is computed in full once, when it is made;
+ *       putting a new ack into it only patches the CRC for the bytes that
+ *       changed.  Bare acks of a flow reuse one packet the same way.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <deque>
+#include <vector>
+
+#include "rdt_struct.h"
+#include "rdt_endpoint.h"
+#include "rdt_common.h"
+#include "rdt_evtrace.h"
+#include "rdt_stats.h"
+
+/* the one-byte sack field has a bit for every packet of the window after
+   the first */
+static_assert(window_size - 1 <= 8, "window_size does not fit the sack field");
+
+/* a packet sent but not acked yet */
+struct tx_slot {
+    packet *pkt;
+    double due;             // retransmitted at this time unless acked
+    bool sacked;
+    bool fast_resent;       // resent early on selective acks already
+};
+
+/* later packets selectively acked before a hole is taken as a loss */
+static const unsigned int dup_thresh = 2;
+static const unsigned int drain_dup_thresh = 1;    // in the tail of a flow
+
+/* an endpoint of a flow */
+struct conn {
+    unsigned int flow;
+
+    /* sending half */
+    std::deque<message *> pending_msg;
+    std::deque<tx_slot> window;
+    unsigned int seq;       // seq of the next new packet
+    bool draining;          // the upper layer passes no more messages
+
+    /* receiving half */
+    unsigned int expect_seq;
+    std::deque<packet *> reorder;
+    unsigned int unacked;   // packets arrived in order since the last ack
+    bool ack_pending;
+    double ack_due;         // the pending ack is sent bare at this time
+    packet *bare_ack;       // sent for every bare ack, made on first use
+
+    double timer_due;       // the flow timer expires at this time, <0 if not set
+};
+
+struct endpoint {
+    struct endpoint_env env;
+    std::vector<conn *> conns;    // demux table, indexed by flow id
+};
+
+/* crc32 is affine rather than linear, its initial value and final xor
+   adding a constant term that depends only on the length.  between two
+   inputs of equal length that constant cancels, so when byte i of the ack
+   and sack fields of a packet changes by xor with x, its CRC changes by
+   xor with ack_crc[i][x], whatever the other bytes hold */
+static unsigned int ack_crc[5][256];
+static bool ack_crc_ready = false;
+
+static void init_ack_crc()
+{
+    if (ack_crc_ready) {
+        return;
+    }
+    packet p;
+    memset(&p, 0, sizeof(packet));
+    unsigned int zero = crc32(p.data + 4, RDT_PKTSIZE - 4);
+    for (unsigned int i = 0; i < 5; ++i) {
+        ack_crc[i][0] = 0;
+        for (unsigned int b = 0; b < 8; ++b) {
+            p.data[12 + i] = 1 << b;
+            unsigned int bit = crc32(p.data + 4, RDT_PKTSIZE - 4) ^ zero;
+            for (unsigned int x = 0; x < (1u << b); ++x) {
+                ack_crc[i][x | 1 << b] = ack_crc[i][x] ^ bit;
+            }
+        }
+        p.data[12 + i] = 0;
+    }
+    ack_crc_ready = true;
+}
+
+/* the upper layer is done and every message is in a packet */
+static bool in_tail(const conn *c)
+{
+    return c->draining && c->pending_msg.empty();
+}
+
+/* create a packet from pending messages
+ * returns NULL if not possible
+ */
+static packet *create_packet(conn *c)
+{
+    if (c->pending_msg.empty()) {
+        return NULL;
+    }
+    packet *res = (packet *)malloc(sizeof(packet));
+    memset(res, 0, sizeof(packet));
+    unsigned int off = header_size;
+    while (!c->pending_msg.empty()) {
+        message *msg = c->pending_msg.front();
+        c->pending_msg.pop_front();
+
+        int size = RDT_PKTSIZE - off;
+        if (msg->size < size) {
+            size = msg->size;
+        }
+        memcpy(res->data + off, msg->data, size);
+        off += size;
+        if (size == msg->size) {
+            free(msg->data);
+            free(msg);
+        }
+        else {
+            msg->size = msg->size - size;
+            char *d = (char *)malloc(sizeof(char) * msg->size);
+            memcpy(d, msg->data + size, msg->size);
+            free(msg->data);
+            msg->data = d;
+            c->pending_msg.push_front(msg);
+            break;
+        }
+    }
+    PKT_FLOW(res) = c->flow;
+    PKT_SEQ(res) = c->seq;
+    PKT_SIZE(res) = off - header_size;
+    PKT_CRC(res) = crc32(res->data + 4, RDT_PKTSIZE - 4);
+    ++c->seq;
+    return res;
+}
+
+/* put the current cumulative and selective ack into a sealed packet */
+static void fill_ack(conn *c, packet *pkt)
+{
+    unsigned char sack = 0;
+    for (unsigned int i = 1; i < window_size; ++i) {
+        if (c->reorder[i] != NULL) {
+            sack |= 1 << (i - 1);
+        }
+    }
+    unsigned int ack_xor = PKT_ACK(pkt) ^ (c->expect_seq - 1);
+    unsigned char sack_xor = PKT_SACK(pkt) ^ sack;
+    PKT_CRC(pkt) ^= ack_crc[0][ack_xor & 0xff] ^ ack_crc[1][(ack_xor >> 8) & 0xff] ^
+        ack_crc[2][(ack_xor >> 16) & 0xff] ^ ack_crc[3][ack_xor >> 24] ^ ack_crc[4][sack_xor];
+    PKT_ACK(pkt) = c->expect_seq - 1;
+    PKT_SACK(pkt) = sack;
+}
+
+/* the pending ack has gone out */
+static void ack_sent(conn *c)
+{
+    c->ack_pending = false;
+    c->unacked = 0;
+}
+
+/* send data packets, each carrying the current ack */
+static void transmit(endpoint *ep, conn *c, packet **batch, int n)
+{
+    if (n == 0) {
+        return;
+    }
+    for (int i = 0; i < n; ++i) {
+        fill_ack(c, batch[i]);
+    }
+    stats.data_pkts += n;
+    if (c->ack_pending) {
+        stats.piggy_acks++;
+        ack_sent(c);
+    }
+    ep->env.to_lower(batch, n);
+}
+
+/* send a bare ack */
+static void send_ack(endpoint *ep, conn *c)
+{
+    if (c->bare_ack == NULL) {
+        c->bare_ack = (packet *)malloc(sizeof(packet));
+        memset(c->bare_ack, 0, sizeof(packet));
+        PKT_FLOW(c->bare_ack) = c->flow;
+        PKT_CRC(c->bare_ack) = crc32(c->bare_ack->data + 4, RDT_PKTSIZE - 4);
+    }
+    fill_ack(c, c->bare_ack);
+    ep->env.to_lower(&c->bare_ack, 1);
+    stats.ack_pkts++;
+    evtrace(GetSimulationTime(), EV_ACK_SEND, ep->env.side, c->flow, 0, c->expect_seq - 1, 0);
+    ack_sent(c);
+}
+
+/* ack the arrived data no later than due */
+static void schedule_ack(conn *c, double due)
+{
+    if (!c->ack_pending || due < c->ack_due) {
+        c->ack_due = due;
+    }
+    c->ack_pending = true;
+}
+
+/*
+ * send some packet if possible
+ */
+static void send_data(endpoint *ep, conn *c)
+{
+    packet *batch[window_size];
+    int n = 0;
+    double now = GetSimulationTime();
+    while (c->window.size() < window_size) {
+        packet *pkt = create_packet(c);
+        if (pkt == NULL) {
+            break;
+        }
+        tx_slot s = {pkt, now + timeout, false, false};
+        c->window.push_back(s);
+        batch[n++] = pkt;
+        evtrace(now, EV_DATA_SEND, ep->env.side, c->flow, PKT_SEQ(pkt),
+                c->expect_seq - 1, c->window.size());
+    }
+    transmit(ep, c, batch, n);
+}
+
+/* send the pending ack if it is due */
+static void flush_ack(endpoint *ep, conn *c)
+{
+    if (c->ack_pending && c->ack_due <= GetSimulationTime()) {
+        send_ack(ep, c);
+    }
+}
+
+/* set the flow timer for the earliest retransmission or pending ack */
+static void rearm(endpoint *ep, conn *c)
+{
+    double due = c->ack_pending ? c->ack_due : -1;
+    for (unsigned int i = 0; i < c->window.size(); ++i) {
+        const tx_slot &s = c->window[i];
+        if (!s.sacked && (due < 0 || s.due < due)) {
+            due = s.due;
+        }
+    }
+    if (due == c->timer_due) {
+        return;
+    }
+    c->timer_due = due;
+    if (due < 0) {
+        ep->env.stop_timer(c->flow);
+    }
+    else {
+        double left = due - GetSimulationTime();
+        ep->env.start_timer(c->flow, left > 0 ? left : 0);
+    }
+}
+
+/* the ack part of an arrived packet */
+static void receive_ack(endpoint *ep, conn *c, packet *pkt)
+{
+    unsigned int ack = PKT_ACK(pkt);
+    while (!c->window.empty() && seq_before_eq(PKT_SEQ(c->window.front().pkt), ack)) {
+        free(c->window.front().pkt);
+        c->window.pop_front();
+    }
+    unsigned char sack = PKT_SACK(pkt);
+    if (sack != 0 && !c->window.empty()) {
+        unsigned int base = PKT_SEQ(c->window.front().pkt);
+        for (unsigned int i = 0; i + 1 < window_size; ++i) {
+            unsigned int k = ack + 2 + i - base;
+            if ((sack & (1 << i)) && k < c->window.size()) {
+                c->window[k].sacked = true;
+            }
+        }
+    }
+    evtrace(GetSimulationTime(), EV_ACK_RECV, ep->env.side, c->flow, 0, ack, c->window.size());
+}
+
+/* resend at once the packets the selective acks tell lost */
+static void fast_retransmit(endpoint *ep, conn *c)
+{
+    packet *batch[window_size];
+    int n = 0;
+    double now = GetSimulationTime();
+    unsigned int thresh = in_tail(c) ? drain_dup_thresh : dup_thresh;
+    unsigned int later = 0;
+    for (int i = (int)c->window.size() - 1; i >= 0; --i) {
+        tx_slot &s = c->window[i];
+        if (s.sacked) {
+            ++later;
+        }
+        else if (later >= thresh && !s.fast_resent) {
+            batch[n++] = s.pkt;
+            s.fast_resent = true;
+            s.due = now + timeout;
+            stats.retransmits++;
+            evtrace(now, EV_DATA_RESEND, ep->env.side, c->flow, PKT_SEQ(s.pkt),
+                    c->expect_seq - 1, c->window.size());
+        }
+    }
+    transmit(ep, c, batch, n);
+}
+
+/* the data part of an arrived packet */
+static void receive_data(endpoint *ep, conn *c, packet *pkt)
+{
+    double now = GetSimulationTime();
+    unsigned int seq = PKT_SEQ(pkt);
+    bool immediate = true;
+    if (seq - c->expect_seq < window_size) { // selective repeat
+        unsigned int k = seq - c->expect_seq;
+        if (c->reorder[k] == NULL) {
+            packet *p = (packet *)malloc(sizeof(packet));
+            *p = *pkt;
+            c->reorder[k] = p;
+            /* in order without filling a gap, this ack may wait */
+            if (k == 0 && c->reorder[1] == NULL) {
+                immediate = ++c->unacked >= 2;
+            }
+        }
+        else {
+            stats.dup_pkts++;
+        }
+        while (c->reorder.front()) {
+            ++c->expect_seq;
+            packet *p = c->reorder.front();
+            c->reorder.pop_front();
+            c->reorder.push_back(NULL);
+
+            /* construct a message and deliver to the upper layer */
+            message *msg = (message *)malloc(sizeof(message));
+            ASSERT(msg!=NULL);
+            msg->size = PKT_SIZE(p);
+            msg->data = (char *)malloc(sizeof(char) * msg->size);
+            ASSERT(msg->data!=NULL);
+            memcpy(msg->data, p->data+header_size, msg->size);
+            ep->env.to_upper(c->flow, msg);
+            evtrace(now, EV_DELIVER, ep->env.side, c->flow, c->expect_seq - 1, 0, 0);
+            /* don't forget to free the space */
+            free(p);
+            if (msg->data!=NULL) free(msg->data);
+            if (msg!=NULL) free(msg);
+        }
+    }
+    else if (!seq_before_eq(c->expect_seq, seq)) { // ack is missing
+        stats.dup_pkts++;
+    }
+    else { // beyond the window
+        return;
+    }
+    schedule_ack(c, immediate ? now : now + ack_delay);
+}
+
+struct endpoint *endpoint_create(const struct endpoint_env *env, unsigned int flows)
+{
+    init_ack_crc();
+    endpoint *ep = new endpoint;
+    ep->env = *env;
+    ep->conns.resize(flows);
+    for (unsigned int i = 0; i < flows; ++i) {
+        conn *c = new conn;
+        c->flow = i;
+        c->seq = 1;
+        c->draining = false;
+        c->expect_seq = 1;
+        c->reorder.resize(window_size);
+        c->unacked = 0;
+        c->ack_pending = false;
+        c->ack_due = 0;
+        c->bare_ack = NULL;
+        c->timer_due = -1;
+        ep->conns[i] = c;
+    }
+    return ep;
+}
+
+void endpoint_destroy(struct endpoint *ep)
+{
+    for (unsigned int i = 0; i < ep->conns.size(); ++i) {
+        conn *c = ep->conns[i];
+        for (unsigned int j = 0; j < c->pending_msg.size(); ++j) {
+            free(c->pending_msg[j]->data);
+            free(c->pending_msg[j]);
+        }
+        for (unsigned int j = 0; j < c->window.size(); ++j) {
+            free(c->window[j].pkt);
+        }
+        for (unsigned int j = 0; j < c->reorder.size(); ++j) {
+            free(c->reorder[j]);
+        }
+        free(c->bare_ack);
+        delete c;
+    }
+    delete ep;
+}
+
+void endpoint_from_upper(struct endpoint *ep, unsigned int flow, struct message *msg)
+{
+    /* an empty message adds nothing to the stream, and a packet without
+       payload would be taken for a bare ack */
+    if (msg->size <= 0) {
+        return;
+    }
+    message *m = (message *)malloc(sizeof(message));
+    m->size = msg->size;
+    m->data = (char *)malloc(sizeof(char) * m->size);
+    memcpy(m->data, msg->data, m->size);
+
+    conn *c = ep->conns[flow];
+    c->pending_msg.push_back(m);
+
+    send_data(ep, c);
+    rearm(ep, c);
+}
+
+void endpoint_from_lower(struct endpoint *ep, struct packet *pkt)
+{
+    if (crc32(pkt->data + 4, RDT_PKTSIZE - 4) != PKT_CRC(pkt)) { // ignore corrupted packets
+        return;
+    }
+    unsigned int flow = PKT_FLOW(pkt);
+    if (flow >= ep->conns.size()) {
+        return;
+    }
+    conn *c = ep->conns[flow];
+    receive_ack(ep, c, pkt);
+    if (PKT_SIZE(pkt) > 0) {
+        receive_data(ep, c, pkt);
+    }
+    fast_retransmit(ep, c);
+    send_data(ep, c);
+    flush_ack(ep, c);
+    rearm(ep, c);
+}
+
+void endpoint_timeout(struct endpoint *ep, unsigned int flow)
+{
+    conn *c = ep->conns[flow];
+    double now = GetSimulationTime();
+    c->timer_due = -1;
+
+    packet *batch[2 * window_size];
+    int n = 0;
+    for (unsigned int i = 0; i < c->window.size(); ++i) {
+        tx_slot &s = c->window[i];
+        if (!s.sacked && s.due <= now) {
+            batch[n++] = s.pkt; // resend timeout packages
+            stats.retransmits++;
+            if (in_tail(c)) {
+                batch[n++] = s.pkt;
+                stats.retransmits++;
+            }
+            s.due = now + timeout;
+            evtrace(now, EV_DATA_RESEND, ep->env.side, flow, PKT_SEQ(s.pkt),
+                    c->expect_seq - 1, c->window.size());
+        }
+    }
+    transmit(ep, c, batch, n);
+    flush_ack(ep, c);
+    rearm(ep, c);
+}
+
+void endpoint_drain(struct endpoint *ep, unsigned int flow)
+{
+    ep->conns[flow]->draining = true;
+}
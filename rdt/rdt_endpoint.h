@@ -0,0 +1,62 @@
+/*
+ * FILE: rdt_endpoint.h
+ * DESCRIPTION: The header file for a reliable data transfer endpoint,
+ *     shared by the sender and the receiver.  An endpoint both sends the
+ *     messages of its upper layer and delivers the ones of its peer, so
+ *     a flow carries data in both directions.
+ * NOTE: Every packet is laid out as the following:
+ *
+ *       |<- 4 byte ->|<- 4 byte ->|<- 4 byte ->|<- 4 byte ->|<- 1 byte ->|<- 1 byte ->|<- the rest ->|
+ *       |<-  CRC32 ->|<-  flow  ->|<-  seq   ->|<-  ack   ->|<-  sack  ->|<-  size  ->|<- payload  ->|
+ *
+ *       ack is the cumulative ack of the data coming the other way, and
+ *       bit i of sack tells that packet ack+2+i arrived out of order.  a
+ *       packet without payload is a bare ack and its seq is unused.
+ */
+
+
+#ifndef _RDT_ENDPOINT_H_
+#define _RDT_ENDPOINT_H_
+
+#include "rdt_struct.h"
+
+/* the header fields of a packet, laid out as above */
+#define PKT_CRC(p)  (*(unsigned int *)((p)->data))
+#define PKT_FLOW(p) (*(unsigned int *)((p)->data + 4))
+#define PKT_SEQ(p)  (*(unsigned int *)((p)->data + 8))
+#define PKT_ACK(p)  (*(unsigned int *)((p)->data + 12))
+#define PKT_SACK(p) (*(unsigned char *)((p)->data + 16))
+#define PKT_SIZE(p) (*(unsigned char *)((p)->data + 17))
+
+/* get simulation time (in seconds) */
+double GetSimulationTime();
+
+/* the routines through which an endpoint reaches its surroundings */
+struct endpoint_env {
+    unsigned int side;      /* 0 at the sender, 1 at the receiver */
+    void (*to_lower)(struct packet **pkts, int n);
+    void (*to_upper)(unsigned int flow, struct message *msg);
+    void (*start_timer)(unsigned int flow, double timeout);
+    void (*stop_timer)(unsigned int flow);
+};
+
+struct endpoint;
+
+/* an endpoint of flows numbered from 0 */
+struct endpoint *endpoint_create(const struct endpoint_env *env, unsigned int flows);
+void endpoint_destroy(struct endpoint *ep);
+
+/* a message of a flow passed down by the upper layer */
+void endpoint_from_upper(struct endpoint *ep, unsigned int flow, struct message *msg);
+
+/* a packet arrived from the lower layer */
+void endpoint_from_lower(struct endpoint *ep, struct packet *pkt);
+
+/* the timer of a flow expired */
+void endpoint_timeout(struct endpoint *ep, unsigned int flow);
+
+/* the upper layer passes no more messages of a flow, so the endpoint may
+   hurry to get the rest through */
+void endpoint_drain(struct endpoint *ep, unsigned int flow);
+
+#endif /* _RDT_ENDPOINT_H_ */
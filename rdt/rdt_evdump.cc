@@ -0,0 +1,185 @@
+/*
+ * FILE: rdt_evdump.cc
+ * DESCRIPTION: Offline decoder for binary event traces written by rdt_sim.
+ *     Prints a trace as text, as CSV, or as a sender/receiver timeline.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "rdt_evtrace.h"
+
+enum {FORMAT_TEXT=0, FORMAT_CSV, FORMAT_TIMELINE};
+
+/* print a record the way rdt_sim prints its text traces */
+static void print_text(const struct evtrace_record *r)
+{
+    const char *who = r->side ? "Receiver" : "Sender";
+
+    switch (r->type) {
+    case EV_UPPER_MESSAGE:
+        printf("Time %.2fs (%s): the upper layer instructs rdt layer to send out a message of flow %u.\n", r->time, who, r->flow);
+        break;
+    case EV_SENDER_PACKET:
+        printf("Time %.2fs (Sender): the lower layer informs the rdt layer that a packet is received from the link.\n", r->time);
+        break;
+    case EV_TIMEOUT:
+        printf("Time %.2fs (%s): the timer of flow %u expires.\n", r->time, who, r->flow);
+        break;
+    case EV_RECEIVER_PACKET:
+        printf("Time %.2fs (Receiver): the lower layer informs the rdt layer that a packet is received from the link.\n", r->time);
+        break;
+    case EV_TIMER_START:
+        printf("Time %.2fs (%s): the timer of flow %u is started (expires at %.2fs).\n",
+               r->time, who, r->flow, r->time + r->seq / 1000000.0);
+        break;
+    case EV_TIMER_STOP:
+        printf("Time %.2fs (%s): the timer of flow %u is stopped.\n", r->time, who, r->flow);
+        break;
+    case EV_DATA_SEND:
+    case EV_DATA_RESEND:
+        printf("Time %.2fs (%s): flow %u %s packet %u with ack %u, %u packets in window.\n",
+               r->time, who, r->flow, r->type==EV_DATA_SEND ? "sent" : "resent", r->seq,
+               r->ack, r->win);
+        break;
+    case EV_ACK_RECV:
+        printf("Time %.2fs (%s): flow %u ack %u accepted, %u packets in window.\n",
+               r->time, who, r->flow, r->ack, r->win);
+        break;
+    case EV_DELIVER:
+        printf("Time %.2fs (%s): flow %u packet %u delivered.\n", r->time, who, r->flow, r->seq);
+        break;
+    case EV_ACK_SEND:
+        printf("Time %.2fs (%s): flow %u ack %u sent.\n", r->time, who, r->flow, r->ack);
+        break;
+    default:
+        printf("Time %.2fs: undefined event %u\n", r->time, r->type);
+        break;
+    }
+}
+
+/* the flow of a record as printed, empty for none */
+static const char *flow_name(const struct evtrace_record *r, char *buf, size_t size)
+{
+    if (r->flow==EVTRACE_NO_FLOW) return "";
+    snprintf(buf, size, "%u", r->flow);
+    return buf;
+}
+
+/* print a record in two columns, the sender on the left and the receiver on
+   the right, prefixed with its flow */
+static void print_timeline(const struct evtrace_record *r)
+{
+    char desc[64];
+    char flow[16];
+    bool at_receiver = r->side!=0;
+
+    switch (r->type) {
+    case EV_TIMER_START:
+        snprintf(desc, sizeof(desc), "timer +%.3fs", r->seq / 1000000.0);
+        break;
+    case EV_DATA_SEND:
+    case EV_DATA_RESEND:
+        snprintf(desc, sizeof(desc), "%s %u ack %u [win %u] %s",
+                 r->type==EV_DATA_SEND ? "data" : "RESEND", r->seq, r->ack, r->win,
+                 at_receiver ? "<--" : "-->");
+        break;
+    case EV_ACK_RECV:
+        snprintf(desc, sizeof(desc), "ack %u [win %u]", r->ack, r->win);
+        break;
+    case EV_DELIVER:
+        snprintf(desc, sizeof(desc), "deliver %u", r->seq);
+        break;
+    case EV_ACK_SEND:
+        snprintf(desc, sizeof(desc), "%s ack %u", at_receiver ? "<--" : "-->", r->ack);
+        break;
+    case EV_RECEIVER_PACKET:
+        snprintf(desc, sizeof(desc), "%s", evtrace_name(r->type));
+        at_receiver = true;
+        break;
+    default:
+        snprintf(desc, sizeof(desc), "%s", evtrace_name(r->type));
+        break;
+    }
+
+    if (at_receiver)
+        printf("%10.4f %6s | %-32s | %s\n", r->time, flow_name(r, flow, sizeof(flow)), "", desc);
+    else
+        printf("%10.4f %6s | %-32s |\n", r->time, flow_name(r, flow, sizeof(flow)), desc);
+}
+
+int main(int argc, char *argv[])
+{
+    int format = FORMAT_TEXT;
+    int opt;
+    while ((opt = getopt(argc, argv, "f:")) != -1) {
+        if (opt=='f' && strcmp(optarg, "text")==0)
+            format = FORMAT_TEXT;
+        else if (opt=='f' && strcmp(optarg, "csv")==0)
+            format = FORMAT_CSV;
+        else if (opt=='f' && strcmp(optarg, "timeline")==0)
+            format = FORMAT_TIMELINE;
+        else
+            argc = 0;
+    }
+    if (argc-optind!=1) {
+        fprintf(stderr, "usage: %s [-f text|csv|timeline] <event_trace>\n", argv[0]);
+        exit(-1);
+    }
+
+    const char *path = argv[optind];
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd<0 || fstat(fd, &st)<0) {
+        perror(path);
+        exit(-1);
+    }
+    size_t hdr = strlen(EVTRACE_MAGIC);
+    if ((size_t)st.st_size<hdr) {
+        fprintf(stderr, "%s: not an event trace\n", path);
+        exit(-1);
+    }
+    char *base = (char *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base==MAP_FAILED) {
+        perror(path);
+        exit(-1);
+    }
+    close(fd);
+    if (memcmp(base, EVTRACE_MAGIC, hdr)!=0 ||
+        (st.st_size - hdr) % sizeof(struct evtrace_record)!=0) {
+        fprintf(stderr, "%s: not an event trace\n", path);
+        exit(-1);
+    }
+    madvise(base, st.st_size, MADV_SEQUENTIAL);
+
+    const struct evtrace_record *rec = (const struct evtrace_record *)(base + hdr);
+    size_t n = (st.st_size - hdr) / sizeof(struct evtrace_record);
+
+    if (format==FORMAT_CSV)
+        printf("time,event,side,flow,seq,ack,window\n");
+    char flow[16];
+    for (size_t i = 0; i < n; ++i) {
+        const struct evtrace_record *r = &rec[i];
+        switch (format) {
+        case FORMAT_TEXT:
+            print_text(r);
+            break;
+        case FORMAT_CSV:
+            printf("%.6f,%s,%u,%s,%u,%u,%u\n", r->time, evtrace_name(r->type), r->side,
+                   flow_name(r, flow, sizeof(flow)), r->seq, r->ack, r->win);
+            break;
+        case FORMAT_TIMELINE:
+            print_timeline(r);
+            break;
+        }
+    }
+
+    munmap(base, st.st_size);
+    return 0;
+}
@@ -0,0 +1,131 @@
+/*
+ * FILE: rdt_event.h
+ * DESCRIPTION: The header file for the generic event chain framework, the
+ *     core of the simulation.
+ */
+
+
+#ifndef _RDT_EVENT_H_
+#define _RDT_EVENT_H_
+
+#include <stdio.h>
+
+#include <vector>
+
+/* simulation event base class */
+class Event
+{
+public:
+    double sched_time;      /* scheduled occuring time */
+    int event_type;         /* application-specific event type */
+    unsigned long long sched_order; /* orders events scheduled for the same time */
+    int chain_pos;          /* position in the event chain, -1 if not in it */
+
+public:
+    Event() { chain_pos = -1; }
+};
+
+/* event chain class - the simulation core.  the chain is a binary heap 
+   ordered by sched_time, events scheduled for the same time occur in the 
+   order they were scheduled */
+class EventChain
+{
+public:
+    double sim_time;        /* simulation time */
+    std::vector<Event *> heap;
+    unsigned long long sched_count;
+
+public:
+    EventChain() {
+	sim_time = 0;
+	sched_count = 0;
+    }
+
+    double time() { return sim_time; }
+
+    bool empty() { return heap.empty(); }
+
+    /* schedule an event */
+    void schedule(Event *e) {
+	/* do nothing if the event is schedule for the past */
+	if (e->sched_time<sim_time) return;
+
+	e->sched_order = sched_count++;
+	e->chain_pos = heap.size();
+	heap.push_back(e);
+	sift_up(e->chain_pos);
+    }
+
+    /* cancel an event scheduled for happening in the future */
+    void cancel(Event *e) {
+	int pos = e->chain_pos;
+	if (pos<0 || pos>=(int)heap.size() || heap[pos]!=e) return;
+	remove(pos);
+    }
+
+    /* the next event, without advancing to it */
+    Event *peek() {
+	return heap.empty() ? NULL : heap[0];
+    }
+
+    /* advance to the next event */
+    Event *next_event() {
+	if (heap.empty()) return NULL;
+
+	Event *e = heap[0];
+	remove(0);
+	sim_time = e->sched_time;
+
+	return e;
+    }
+
+private:
+    static bool before(const Event *a, const Event *b) {
+	return a->sched_time<b->sched_time ||
+	    (a->sched_time==b->sched_time && a->sched_order<b->sched_order);
+    }
+
+    void place(Event *e, int pos) {
+	heap[pos] = e;
+	e->chain_pos = pos;
+    }
+
+    void sift_up(int pos) {
+	Event *e = heap[pos];
+	while (pos>0) {
+	    int parent = (pos-1)/2;
+	    if (!before(e, heap[parent])) break;
+	    place(heap[parent], pos);
+	    pos = parent;
+	}
+	place(e, pos);
+    }
+
+    void sift_down(int pos) {
+	Event *e = heap[pos];
+	int n = heap.size();
+	for (;;) {
+	    int child = 2*pos+1;
+	    if (child>=n) break;
+	    if (child+1<n && before(heap[child+1], heap[child])) child++;
+	    if (!before(heap[child], e)) break;
+	    place(heap[child], pos);
+	    pos = child;
+	}
+	place(e, pos);
+    }
+
+    void remove(int pos) {
+	Event *e = heap[pos];
+	Event *last = heap.back();
+	heap.pop_back();
+	e->chain_pos = -1;
+	if (pos<(int)heap.size()) {
+	    place(last, pos);
+	    sift_down(pos);
+	    sift_up(last->chain_pos);
+	}
+    }
+};
+
+#endif /* _RDT_EVENT_H_ */
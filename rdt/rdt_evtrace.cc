@@ -0,0 +1,84 @@
+/*
+ * FILE: rdt_evtrace.cc
+ * DESCRIPTION: Binary event tracing
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "rdt_evtrace.h"
+
+thread_local bool evtrace_enabled = false;
+thread_local unsigned int evtrace_head = 0;
+thread_local struct evtrace_record evtrace_ring[EVTRACE_RING];
+
+static int evtrace_fd = -1;
+
+/* serializes the writes of the threads' rings */
+static pthread_mutex_t evtrace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *evtrace_names[EV_TYPES] = {
+    "upper_message", "sender_packet", "timeout", "receiver_packet",
+    "timer_start", "timer_stop", "data_send", "data_resend", "ack_recv",
+    "deliver", "ack_send"
+};
+
+/* write all of buf, returns false on error */
+static bool write_all(const char *buf, size_t len)
+{
+    while (len>0) {
+        ssize_t n = write(evtrace_fd, buf, len);
+        if (n<0) return false;
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool evtrace_open(const char *path)
+{
+    evtrace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (evtrace_fd<0 || !write_all(EVTRACE_MAGIC, strlen(EVTRACE_MAGIC))) {
+        perror(path);
+        return false;
+    }
+    evtrace_thread_init();
+    return true;
+}
+
+void evtrace_thread_init()
+{
+    evtrace_head = 0;
+    evtrace_enabled = evtrace_fd>=0;
+}
+
+void evtrace_flush()
+{
+    if (evtrace_head>0) {
+        pthread_mutex_lock(&evtrace_lock);
+        bool ok = write_all((const char *)evtrace_ring, evtrace_head * sizeof(struct evtrace_record));
+        pthread_mutex_unlock(&evtrace_lock);
+        if (!ok) {
+            perror("event trace");
+            evtrace_enabled = false;
+        }
+    }
+    evtrace_head = 0;
+}
+
+void evtrace_close()
+{
+    if (evtrace_fd<0) return;
+    evtrace_flush();
+    close(evtrace_fd);
+    evtrace_fd = -1;
+    evtrace_enabled = false;
+}
+
+const char *evtrace_name(unsigned int type)
+{
+    return type<EV_TYPES ? evtrace_names[type] : "unknown";
+}
@@ -0,0 +1,97 @@
+/*
+ * FILE: rdt_evtrace.h
+ * DESCRIPTION: The header file for binary event tracing.
+ * NOTE: Events are appended to an in-memory ring of fixed size records
+ *       which is written out whenever it fills up.  The trace file is
+ *       laid out as the following:
+ *
+ *       |<-  8 byte  ->|<-           32 byte each            ->|
+ *       |<- RDTEVT03 ->|<-             records               ->|
+ *
+ *       and each record as:
+ *
+ *       |<- 8 byte ->|<- 4 byte ->|<- 4 byte ->|<- 4 byte ->|<- 4 byte ->|<- 4 byte ->|<- 4 byte ->|
+ *       |<-  time  ->|<-  type  ->|<-  flow  ->|<-  seq   ->|<-  ack   ->|<- window ->|<-  side  ->|
+ *
+ *       side is 0 for events at the sender and 1 for those at the
+ *       receiver.  for the timer start event, seq holds the timeout in
+ *       microseconds.  packet arrivals are recorded before the packet is
+ *       decoded, so their flow is EVTRACE_NO_FLOW.
+ *       every thread buffers its records in a ring of its own, so the
+ *       records of different threads are interleaved ring by ring rather
+ *       than in time order.  use rdt_evdump to decode a trace file.
+ */
+
+
+#ifndef _RDT_EVTRACE_H_
+#define _RDT_EVTRACE_H_
+
+#define EVTRACE_MAGIC "RDTEVT03"
+
+/* the flow of an event that belongs to no known flow */
+#define EVTRACE_NO_FLOW 0xFFFFFFFFu
+
+/* number of records buffered before they are written out */
+#define EVTRACE_RING 8192
+
+enum {EV_UPPER_MESSAGE=0,   /* simulator: upper layer passes a message */
+      EV_SENDER_PACKET,     /* simulator: packet arrives at the sender */
+      EV_TIMEOUT,           /* simulator: timer of a side expires */
+      EV_RECEIVER_PACKET,   /* simulator: packet arrives at the receiver */
+      EV_TIMER_START,       /* simulator: timer of a side started */
+      EV_TIMER_STOP,        /* simulator: timer of a side stopped */
+      EV_DATA_SEND,         /* endpoint: data packet sent for the first time */
+      EV_DATA_RESEND,       /* endpoint: data packet retransmitted */
+      EV_ACK_RECV,          /* endpoint: ack accepted */
+      EV_DELIVER,           /* endpoint: packet delivered to the upper layer */
+      EV_ACK_SEND,          /* endpoint: bare ack sent */
+      EV_TYPES};
+
+struct evtrace_record {
+    double time;
+    unsigned int type;
+    unsigned int flow;
+    unsigned int seq;
+    unsigned int ack;
+    unsigned int win;
+    unsigned int side;
+};
+
+extern thread_local bool evtrace_enabled;
+extern thread_local unsigned int evtrace_head;
+extern thread_local struct evtrace_record evtrace_ring[EVTRACE_RING];
+
+/* create the trace file and enable tracing on the calling thread, returns
+   false on error */
+bool evtrace_open(const char *path);
+
+/* enable tracing on the calling thread if a trace file is open */
+void evtrace_thread_init();
+
+/* write out the records buffered by the calling thread */
+void evtrace_flush();
+
+/* write out the remaining records and close the trace file */
+void evtrace_close();
+
+/* the name of an event type */
+const char *evtrace_name(unsigned int type);
+
+/* record an event, a no-op unless tracing is enabled */
+static inline void evtrace(double time, unsigned int type, unsigned int side,
+                           unsigned int flow, unsigned int seq, unsigned int ack,
+                           unsigned int win)
+{
+    if (!evtrace_enabled) return;
+    struct evtrace_record *r = &evtrace_ring[evtrace_head];
+    r->time = time;
+    r->type = type;
+    r->flow = flow;
+    r->seq = seq;
+    r->ack = ack;
+    r->win = win;
+    r->side = side;
+    if (++evtrace_head==EVTRACE_RING) evtrace_flush();
+}
+
+#endif /* _RDT_EVTRACE_H_ */
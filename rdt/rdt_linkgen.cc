@@ -0,0 +1,87 @@
+/*
+ * FILE: rdt_linkgen.cc
+ * DESCRIPTION: Generator of synthetic link traces for rdt_sim -t.  Draws
+ *     the fate of every packet the way rdt_sim does from its rates, so a
+ *     trace reproduces a random link exactly and can be replayed again.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include <vector>
+
+#include "rdt_linktrace.h"
+
+/* rand_r() state */
+static unsigned int rng;
+
+static double myrandom()
+{
+    return rand_r(&rng) * 1.0 / RAND_MAX;
+}
+
+/* fill n records of one direction */
+static void generate(std::vector<struct link_record> &recs, unsigned int n, double latency,
+                     double outoforder_rate, double loss_rate, double corrupt_rate)
+{
+    recs.resize(n);
+    for (unsigned int i = 0; i < n; ++i) {
+        struct link_record *r = &recs[i];
+        r->flags = 0;
+        if (myrandom() < loss_rate)
+            r->flags |= LINKTRACE_LOST;
+        else if (myrandom() < corrupt_rate)
+            r->flags |= LINKTRACE_CORRUPT;
+        double d = myrandom() < outoforder_rate ? latency * 2.0 * myrandom() : latency;
+        r->delay_us = (unsigned int)(d * 1000000.0);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int seed = 1;
+    double latency = 0.1;
+    int opt;
+    while ((opt = getopt(argc, argv, "l:s:")) != -1) {
+        switch (opt) {
+        case 'l':
+            latency = atof(optarg);
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            argc = 0;
+            break;
+        }
+    }
+    if (argc - optind != 6) {
+        fprintf(stderr, "usage: %s [-l <latency>] [-s <seed>] <forward_records> "
+                "<reverse_records> <outoforder_rate> <loss_rate> <corrupt_rate> <link_trace>\n",
+                argv[0]);
+        return 1;
+    }
+    argv += optind - 1;
+
+    unsigned int n_fwd = strtoul(argv[1], NULL, 0);
+    unsigned int n_rev = strtoul(argv[2], NULL, 0);
+    double outoforder_rate = atof(argv[3]);
+    double loss_rate = atof(argv[4]);
+    double corrupt_rate = atof(argv[5]);
+    if (n_fwd == 0 || n_rev == 0) {
+        fprintf(stderr, "a link trace needs records in both directions\n");
+        return 1;
+    }
+    if (latency <= 0 || outoforder_rate < 0 || outoforder_rate > 1 ||
+        loss_rate < 0 || loss_rate > 1 || corrupt_rate < 0 || corrupt_rate > 1) {
+        fprintf(stderr, "invalid latency or rate\n");
+        return 1;
+    }
+
+    rng = seed;
+    std::vector<struct link_record> fwd, rev;
+    generate(fwd, n_fwd, latency, outoforder_rate, loss_rate, corrupt_rate);
+    generate(rev, n_rev, latency, outoforder_rate, loss_rate, corrupt_rate);
+    return linktrace_write(argv[6], &fwd[0], n_fwd, &rev[0], n_rev) ? 0 : 1;
+}
@@ -0,0 +1,140 @@
+/*
+ * FILE: rdt_linktrace.cc
+ * DESCRIPTION: Trace-driven link replay.  The trace file is mapped into
+ *     memory and streamed: pages are read ahead sequentially, and each
+ *     direction drops the pages of its own records once it has replayed
+ *     them, so traces much larger than memory can be replayed.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "rdt_linktrace.h"
+
+/* number of records consumed between two releases of replayed pages */
+const unsigned int release_interval = 1 << 16;
+
+struct link_cursor {
+    const struct link_record *rec;
+    unsigned int count;
+    unsigned int pos;
+    unsigned int since_release;
+    size_t released;            /* bytes of this direction already dropped */
+};
+
+static char *map_base = NULL;
+static size_t map_len = 0;
+static struct link_cursor cursor[2];
+
+bool linktrace_open(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd<0) {
+        perror(path);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st)<0) {
+        perror(path);
+        close(fd);
+        return false;
+    }
+    size_t hdr = strlen(LINKTRACE_MAGIC) + 2 * sizeof(unsigned int);
+    if ((size_t)st.st_size < hdr) {
+        fprintf(stderr, "%s: not a link trace\n", path);
+        close(fd);
+        return false;
+    }
+    map_len = st.st_size;
+    map_base = (char *)mmap(NULL, map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map_base==MAP_FAILED) {
+        perror(path);
+        map_base = NULL;
+        return false;
+    }
+    madvise(map_base, map_len, MADV_SEQUENTIAL);
+
+    unsigned int n_fwd, n_rev;
+    memcpy(&n_fwd, map_base + strlen(LINKTRACE_MAGIC), sizeof(unsigned int));
+    memcpy(&n_rev, map_base + strlen(LINKTRACE_MAGIC) + sizeof(unsigned int), sizeof(unsigned int));
+    if (memcmp(map_base, LINKTRACE_MAGIC, strlen(LINKTRACE_MAGIC))!=0 ||
+        n_fwd==0 || n_rev==0 ||
+        hdr + ((size_t)n_fwd + n_rev) * sizeof(struct link_record) != map_len) {
+        fprintf(stderr, "%s: not a link trace\n", path);
+        linktrace_close();
+        return false;
+    }
+
+    memset(cursor, 0, sizeof(cursor));
+    cursor[LINK_FORWARD].rec = (const struct link_record *)(map_base + hdr);
+    cursor[LINK_FORWARD].count = n_fwd;
+    cursor[LINK_REVERSE].rec = cursor[LINK_FORWARD].rec + n_fwd;
+    cursor[LINK_REVERSE].count = n_rev;
+    return true;
+}
+
+bool linktrace_active()
+{
+    return map_base!=NULL;
+}
+
+/* drop the pages of a direction that have already been replayed */
+static void release_replayed(struct link_cursor *c)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t start = (const char *)c->rec - map_base;
+    size_t done = start + (size_t)c->pos * sizeof(struct link_record);
+    size_t from = (start + c->released + page - 1) / page * page;
+    size_t to = done / page * page;
+    if (to > from) {
+        madvise(map_base + from, to - from, MADV_DONTNEED);
+        c->released = to - start;
+    }
+}
+
+const struct link_record *linktrace_next(int dir)
+{
+    struct link_cursor *c = &cursor[dir];
+    const struct link_record *r = &c->rec[c->pos];
+    if (++c->pos==c->count) {
+        c->pos = 0;
+        c->released = 0;
+    }
+    if (++c->since_release==release_interval) {
+        c->since_release = 0;
+        release_replayed(c);
+    }
+    return r;
+}
+
+bool linktrace_write(const char *path, const struct link_record *fwd, unsigned int n_fwd,
+                     const struct link_record *rev, unsigned int n_rev)
+{
+    FILE *f = fopen(path, "wb");
+    if (f==NULL) {
+        perror(path);
+        return false;
+    }
+    bool ok = fwrite(LINKTRACE_MAGIC, strlen(LINKTRACE_MAGIC), 1, f)==1 &&
+        fwrite(&n_fwd, sizeof(unsigned int), 1, f)==1 &&
+        fwrite(&n_rev, sizeof(unsigned int), 1, f)==1 &&
+        fwrite(fwd, sizeof(struct link_record), n_fwd, f)==n_fwd &&
+        fwrite(rev, sizeof(struct link_record), n_rev, f)==n_rev;
+    if (fclose(f)!=0) ok = false;
+    if (!ok) perror(path);
+    return ok;
+}
+
+void linktrace_close()
+{
+    if (map_base!=NULL) {
+        munmap(map_base, map_len);
+        map_base = NULL;
+        map_len = 0;
+    }
+}
@@ -0,0 +1,55 @@
+/*
+ * FILE: rdt_linktrace.h
+ * DESCRIPTION: The header file for trace-driven link replay.
+ * NOTE: A link trace is a binary file in host byte order laid out as
+ *       the following:
+ *
+ *       |<-  8 byte  ->|<- 4 byte ->|<- 4 byte ->|<- n_fwd * 8 byte ->|<- n_rev * 8 byte ->|
+ *       |<- RDTLINK1 ->|<-  n_fwd ->|<-  n_rev ->|<- forward records->|<- reverse records->|
+ *
+ *       forward records describe packets from the sender to the receiver,
+ *       reverse records those from the receiver to the sender.  each
+ *       record describes the fate of one packet:
+ *
+ *       |<-   4 byte   ->|<- 4 byte ->|
+ *       |<- delay (us) ->|<-  flags ->|
+ *
+ *       the records of a direction are replayed in order and wrap around
+ *       when exhausted.
+ */
+
+
+#ifndef _RDT_LINKTRACE_H_
+#define _RDT_LINKTRACE_H_
+
+#define LINKTRACE_MAGIC "RDTLINK1"
+
+/* record flags */
+#define LINKTRACE_LOST      0x1
+#define LINKTRACE_CORRUPT   0x2
+
+/* link directions */
+enum {LINK_FORWARD=0, LINK_REVERSE};
+
+struct link_record {
+    unsigned int delay_us;
+    unsigned int flags;
+};
+
+/* map a link trace file, returns false (with a message on stderr) on error */
+bool linktrace_open(const char *path);
+
+/* check whether a link trace is being replayed */
+bool linktrace_active();
+
+/* fetch the record for the next packet sent in direction dir */
+const struct link_record *linktrace_next(int dir);
+
+/* write a link trace, returns false (with a message on stderr) on error */
+bool linktrace_write(const char *path, const struct link_record *fwd, unsigned int n_fwd,
+                     const struct link_record *rev, unsigned int n_rev);
+
+/* unmap the link trace */
+void linktrace_close();
+
+#endif /* _RDT_LINKTRACE_H_ */
@@ -0,0 +1,118 @@
+/*
+ * FILE: rdt_payload.cc
+ * DESCRIPTION: Test payload stream generation and verification
+ */
+
+#include <string.h>
+
+#include "rdt_payload.h"
+
+/* characters regenerated at a time during verification */
+const unsigned int verify_block = 512;
+
+static unsigned long long payload_seed;
+
+/* word k of a stream (splitmix64) */
+static inline unsigned long long payload_word(unsigned long long base, unsigned long long k)
+{
+    unsigned long long z = base + (k + 1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+void payload_init(unsigned long long seed)
+{
+    payload_seed = seed;
+}
+
+void payload_fill(unsigned int stream, char *buf, unsigned long long off, unsigned int len)
+{
+    unsigned long long base = payload_seed ^ (stream * 0xD1B54A32D192ED03ULL);
+    unsigned long long w;
+
+    /* the unaligned head and tail are cut out of whole words */
+    if ((off & 7) && len > 0) {
+        char word[8];
+        unsigned int skip = off & 7;
+        unsigned int n = 8 - skip < len ? 8 - skip : len;
+        w = payload_word(base, off >> 3);
+        memcpy(word, &w, 8);
+        memcpy(buf, word + skip, n);
+        buf += n;
+        off += n;
+        len -= n;
+    }
+    while (len >= 8) {
+        w = payload_word(base, off >> 3);
+        memcpy(buf, &w, 8);
+        buf += 8;
+        off += 8;
+        len -= 8;
+    }
+    if (len > 0) {
+        w = payload_word(base, off >> 3);
+        memcpy(buf, &w, len);
+    }
+}
+
+int payload_verify(unsigned int stream, const char *buf, unsigned long long off,
+                   unsigned int len)
+{
+    char expect[verify_block];
+    for (unsigned int done = 0; done < len; done += verify_block) {
+        unsigned int n = len - done < verify_block ? len - done : verify_block;
+        payload_fill(stream, expect, off + done, n);
+        if (memcmp(expect, buf + done, n) != 0) {
+            for (unsigned int i = 0; i < n; ++i) {
+                if (expect[i] != buf[done + i]) return done + i;
+            }
+        }
+    }
+    return -1;
+}
+
+static inline unsigned long long hash_word(unsigned long long h, const char *p)
+{
+    unsigned long long w;
+    memcpy(&w, p, 8);
+    return (h ^ w) * 0x100000001B3ULL;
+}
+
+void stream_hash_init(struct stream_hash *s)
+{
+    memset(s, 0, sizeof(struct stream_hash));
+    s->h = 0xCBF29CE484222325ULL;
+}
+
+void stream_hash_update(struct stream_hash *s, const char *buf, unsigned int len)
+{
+    while (len > 0 && (s->len & 7)) {
+        s->pending[s->len & 7] = *buf++;
+        ++s->len;
+        --len;
+        if ((s->len & 7) == 0) s->h = hash_word(s->h, s->pending);
+    }
+    while (len >= 8) {
+        s->h = hash_word(s->h, buf);
+        s->len += 8;
+        buf += 8;
+        len -= 8;
+    }
+    memcpy(s->pending, buf, len);
+    s->len += len;
+}
+
+unsigned long long stream_hash_final(const struct stream_hash *s)
+{
+    unsigned long long h = s->h;
+    if (s->len & 7) {
+        char word[8];
+        memset(word, 0, 8);
+        memcpy(word, s->pending, s->len & 7);
+        h = hash_word(h, word);
+    }
+    h ^= s->len;
+    h = (h ^ (h >> 33)) * 0xFF51AFD7ED558CCDULL;
+    return h ^ (h >> 33);
+}
@@ -0,0 +1,38 @@
+/*
+ * FILE: rdt_payload.h
+ * DESCRIPTION: The header file for the test payload stream.
+ * NOTE: The characters sent through a flow form one pseudo-random
+ *       stream.  Every 8-byte word of a stream is derived from the seed,
+ *       the stream number and the word's position only, so any part of
+ *       the stream can be regenerated for verification without keeping a
+ *       copy of what was sent.
+ */
+
+
+#ifndef _RDT_PAYLOAD_H_
+#define _RDT_PAYLOAD_H_
+
+/* order-sensitive hash over a character stream, independent of how the
+   stream is split into pieces */
+struct stream_hash {
+    unsigned long long h;
+    unsigned long long len;
+    char pending[8];                /* bytes of the unfinished word */
+};
+
+/* select the streams generated from seed */
+void payload_init(unsigned long long seed);
+
+/* fill buf with the len characters of a stream starting at off */
+void payload_fill(unsigned int stream, char *buf, unsigned long long off, unsigned int len);
+
+/* check buf against a stream starting at off, returns the index of the
+   first wrong character or -1 if buf is correct */
+int payload_verify(unsigned int stream, const char *buf, unsigned long long off,
+                   unsigned int len);
+
+void stream_hash_init(struct stream_hash *s);
+void stream_hash_update(struct stream_hash *s, const char *buf, unsigned int len);
+unsigned long long stream_hash_final(const struct stream_hash *s);
+
+#endif /* _RDT_PAYLOAD_H_ */
@@ -1,35 +1,39 @@
 /*
  * FILE: rdt_receiver.cc
  * DESCRIPTION: Reliable data transfer receiver.
- * NOTE: In this implementation, the packet format is laid out as 
- *       the following:
- *       
- *       |<-  4 byte  ->|<- 4 byte ->|<- 1 byte ->|<-             the rest            ->|
- *       |<-  CRC32   ->|<-  seq   ->|<-  size  ->|<-             payload             ->|
- *
+ * NOTE: The receiver is an endpoint of every flow, see rdt_endpoint.h for
+ *       the protocol and the packet format.  Besides delivering the
+ *       messages of the sender it sends the ones of its own upper layer
+ *       back.
  */
 
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <string.h>
-
-#include <deque>
 
 #include "rdt_struct.h"
 #include "rdt_receiver.h"
-#include "rdt_common.h"
+#include "rdt_endpoint.h"
+
+/* the lower layer at the receiver takes one packet at a time */
+static void receiver_to_lower(struct packet **pkts, int n)
+{
+    for (int i = 0; i < n; ++i) {
+        Receiver_ToLowerLayer(pkts[i]);
+    }
+}
+
+static const struct endpoint_env receiver_env = {
+    1, receiver_to_lower, Receiver_ToUpperLayer, Receiver_StartTimer, Receiver_StopTimer
+};
 
-static unsigned int expect_seq;
-static std::deque<packet *> window;
+static struct endpoint *receiver = NULL;
 
 /* receiver initialization, called once at the very beginning */
-void Receiver_Init()
+void Receiver_Init(unsigned int flows)
 {
     fprintf(stdout, "At %.2fs: receiver initializing ...\n", GetSimulationTime());
-    expect_seq = 1;
-    window.clear();
-    window.resize(window_size);
+    receiver = endpoint_create(&receiver_env, flows);
 }
 
 /* receiver finalization, called once at the very end.
@@ -39,60 +43,32 @@ void Receiver_Init()
 void Receiver_Final()
 {
     fprintf(stdout, "At %.2fs: receiver finalizing ...\n", GetSimulationTime());
+    endpoint_destroy(receiver);
+    receiver = NULL;
+}
+
+/* event handler, called when a message is passed from the upper layer at the 
+   receiver */
+void Receiver_FromUpperLayer(unsigned int flow, struct message *msg)
+{
+    endpoint_from_upper(receiver, flow, msg);
 }
 
 /* event handler, called when a packet is passed from the lower layer at the 
    receiver */
 void Receiver_FromLowerLayer(struct packet *pkt)
 {
-    if (crc32(pkt->data + 4, RDT_PKTSIZE - 4) == *(unsigned int *)pkt->data) { // ignore corrupted packets
-        unsigned int seq = *(unsigned int *)(pkt->data + 4);
-        if (seq >= expect_seq && seq - expect_seq < window_size) { // selective repeat
-            if (window[seq - expect_seq] == NULL) {
-                packet *p = (packet *)malloc(sizeof(packet));
-                *p = *pkt;
-                window[seq - expect_seq] = p;
-            }
-            bool ack_changed = false;
-            while (window.front()) {
-                ack_changed = true;
-                ++expect_seq;
-                packet *p = window.front();
-                window.pop_front();
-                window.push_back(NULL);
+    endpoint_from_lower(receiver, pkt);
+}
 
-                /* construct a message and deliver to the upper layer */
-                message *msg = (message *)malloc(sizeof(message));
-                ASSERT(msg!=NULL);
-                msg->size = p->data[8];
-                msg->data = (char *)malloc(sizeof(char) * msg->size);
-                ASSERT(msg->data!=NULL);
-                memcpy(msg->data, p->data+header_size, msg->size);
-                Receiver_ToUpperLayer(msg);
-                /* don't forget to free the space */
-                free(p);
-                if (msg->data!=NULL) free(msg->data);
-                if (msg!=NULL) free(msg);
-            }
-            if (ack_changed) {
-                /* ack */
-                packet *ack = (packet *)malloc(sizeof(packet));
-                memset(ack, 0, sizeof(packet));
-                *(unsigned int *)(ack->data + 4) = expect_seq - 1;
-                unsigned int crc = crc32(ack->data + 4, RDT_PKTSIZE - 4);
-                *(unsigned int *)ack->data = crc;
-                Receiver_ToLowerLayer(ack);
-                free(ack);
-            }
-        }
-        else if (seq < expect_seq) { // ack is missing
-            packet *ack = (packet *)malloc(sizeof(packet));
-            memset(ack, 0, sizeof(packet));
-            *(unsigned int *)(ack->data + 4) = expect_seq - 1;
-            unsigned int crc = crc32(ack->data + 4, RDT_PKTSIZE - 4);
-            *(unsigned int *)ack->data = crc;
-            Receiver_ToLowerLayer(ack);
-            free(ack);
-        }
-    }
+/* event handler, called when the timer expires */
+void Receiver_Timeout(unsigned int flow)
+{
+    endpoint_timeout(receiver, flow);
+}
+
+/* event handler, called when the upper layer is done with a flow */
+void Receiver_Drain(unsigned int flow)
+{
+    endpoint_drain(receiver, flow);
 }
@@ -1,7 +1,10 @@
 /*
  * FILE: rdt_receiver.h
  * DESCRIPTION: The header file for reliable data transfer receiver.
- * NOTE: Do not touch this file!
+ * NOTE: This is the contract between the receiver and the transports, rdt_sim
+ *       and rdt_udp, which implement the routines it can call and call
+ *       its event handlers.  Flows are numbered from 0 and every routine
+ *       of a flow takes its id.  Keep rdt_sender.h in step when changing it.
  */
 
 
@@ -21,17 +24,28 @@ double GetSimulationTime();
 /* pass a packet to the lower layer at the receiver */
 void Receiver_ToLowerLayer(struct packet *pkt);
 
-/* deliver a message to the upper layer at the receiver */
-void Receiver_ToUpperLayer(struct message *msg);
+/* deliver a message of a flow to the upper layer at the receiver */
+void Receiver_ToUpperLayer(unsigned int flow, struct message *msg);
+
+/* start the receiver timer of a flow with a specified timeout (in seconds),
+   it behaves like the timer of the sender */
+void Receiver_StartTimer(unsigned int flow, double timeout);
+
+/* stop the receiver timer of a flow */
+void Receiver_StopTimer(unsigned int flow);
+
+/* check whether the receiver timer of a flow is being set */
+bool Receiver_isTimerSet(unsigned int flow);
 
 
 /*[]------------------------------------------------------------------------[]
   |  routines to be changed/enhanced by you
   []------------------------------------------------------------------------[]*/
 
-/* receiver initialization, called once at the very beginning.
+/* receiver initialization, called once at the very beginning with the 
+   number of flows, which are numbered from 0.
    this routine is here to help you.  leave it blank if you don't need it.*/
-void Receiver_Init();
+void Receiver_Init(unsigned int flows);
 
 /* receiver finalization, called once at the very end.
    this routine is here to help you.  leave it blank if you don't need it.
@@ -39,8 +53,19 @@ void Receiver_Init();
    memory you allocated in Receiver_init(). */
 void Receiver_Final();
 
+/* event handler, called when a message of a flow is passed from the upper 
+   layer at the receiver, to be sent back to the sender */
+void Receiver_FromUpperLayer(unsigned int flow, struct message *msg);
+
 /* event handler, called when a packet is passed from the lower layer at the 
    receiver */
 void Receiver_FromLowerLayer(struct packet *pkt);
 
+/* event handler, called when the timer of a flow expires */
+void Receiver_Timeout(unsigned int flow);
+
+/* event handler, called once the upper layer at the receiver will pass no
+   more messages of a flow back to the sender */
+void Receiver_Drain(unsigned int flow);
+
 #endif  /* _RDT_RECEIVER_H_ */
@@ -1,7 +1,10 @@
 /*
  * FILE: rdt_sender.h
  * DESCRIPTION: The header file for reliable data transfer sender.
- * NOTE: Do not touch this file!
+ * NOTE: This is the contract between the sender and the transports, rdt_sim
+ *       and rdt_udp, which implement the routines it can call and call
+ *       its event handlers.  Flows are numbered from 0 and every routine
+ *       of a flow takes its id.  Keep rdt_receiver.h in step when changing it.
  */
 
 
@@ -18,30 +21,39 @@
 /* get simulation time (in seconds) */
 double GetSimulationTime();
 
-/* start the sender timer with a specified timeout (in seconds).
+/* start the sender timer of a flow with a specified timeout (in seconds).
    the timer is canceled with Sender_StopTimer() is called or a new 
    Sender_StartTimer() is called before the current timer expires.
    Sender_Timeout() will be called when the timer expires. */
-void Sender_StartTimer(double timeout);
+void Sender_StartTimer(unsigned int flow, double timeout);
 
-/* stop the sender timer */
-void Sender_StopTimer();
+/* stop the sender timer of a flow */
+void Sender_StopTimer(unsigned int flow);
 
-/* check whether the sender timer is being set,
+/* check whether the sender timer of a flow is being set,
    return true if the timer is set, return false otherwise */
-bool Sender_isTimerSet();
+bool Sender_isTimerSet(unsigned int flow);
 
 /* pass a packet to the lower layer at the sender */
 void Sender_ToLowerLayer(struct packet *pkt);
 
+/* pass n packets to the lower layer at the sender at once, the lower layer
+   may send them without copying before it returns */
+void Sender_ToLowerLayerBatch(struct packet **pkts, int n);
+
+/* deliver a message of a flow sent back by the receiver to the upper layer
+   at the sender */
+void Sender_ToUpperLayer(unsigned int flow, struct message *msg);
+
 
 /*[]------------------------------------------------------------------------[]
   |  routines to be changed/enhanced by you
   []------------------------------------------------------------------------[]*/
 
-/* sender initialization, called once at the very beginning.
+/* sender initialization, called once at the very beginning with the number
+   of flows, which are numbered from 0.
    this routine is here to help you.  leave it blank if you don't need it.*/
-void Sender_Init();
+void Sender_Init(unsigned int flows);
 
 /* sender finalization, called once at the very end.
    this routine is here to help you.  leave it blank if you don't need it.
@@ -49,16 +61,21 @@ void Sender_Init();
    memory you allocated in Sender_init(). */
 void Sender_Final();
 
-/* event handler, called when a message is passed from the upper layer at the 
-   sender */
-void Sender_FromUpperLayer(struct message *msg);
+/* event handler, called when a message of a flow is passed from the upper 
+   layer at the sender */
+void Sender_FromUpperLayer(unsigned int flow, struct message *msg);
 
 /* event handler, called when a packet is passed from the lower layer at the 
    sender */
 void Sender_FromLowerLayer(struct packet *pkt);
 
-/* event handler, called when the timer expires */
-void Sender_Timeout();
+/* event handler, called when the timer of a flow expires */
+void Sender_Timeout(unsigned int flow);
+
+/* event handler, called once the upper layer at the sender will pass no
+   more messages of a flow, so that the rest can be hurried through.
+   leave it blank if you don't need it. */
+void Sender_Drain(unsigned int flow);
 
 
 #endif  /* _RDT_SENDER_H_ */
@@ -1,89 +1,38 @@
 /*
  * FILE: rdt_sim.cc
  * DESCRIPTION: The main simulation control module for reliable data transfer.
- * NOTE: You are not supposed to change this file.  You can, however, add some
- *       printouts to help you debugging.  But remember to test it with the 
- *       original version before you turn in your programs.
+ * NOTE: The simulator drives the sender and the receiver of every flow
+ *       through the routines of rdt_sender.h and rdt_receiver.h, with the
+ *       link between them drawn at random from the given rates or replayed
+ *       from a link trace.  Flows are split into contiguous blocks, each
+ *       simulated by a shard with an event chain and a thread of its own.
+ *       A seeded run with one thread is deterministic; rdt_test.sh checks
+ *       such runs against a baseline, so run it after changing this file.
  */
 
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <vector>
 
 #include "rdt_struct.h"
 #include "rdt_sender.h"
 #include "rdt_receiver.h"
-
-
-/*[]------------------------------------------------------------------------[]
-  |  generic event chain framework
-  []------------------------------------------------------------------------[]*/
-
-/* simulation event base class */
-class Event
-{
-public:
-    double sched_time;      /* scheduled occuring time */
-    int event_type;         /* application-specific event type */
-    class Event *next;      /* next event in the chain */
-
-public:
-    Event() { next = NULL; }
-};
-
-/* event chain class - the simulation core */
-class EventChain
-{
-public:
-    double sim_time;        /* simulation time */
-    Event *head;            /* head event in the chain */
-
-public:
-    EventChain() {
-	sim_time = 0;
-	head = NULL;
-    }
-    
-    double time() { return sim_time; }
-    
-    /* schedule an event - the event chain is maintained on an increasing order 
-       of sched_time */
-    void schedule(Event *e) {
-	/* do nothing if the event is schedule for the past */
-	if (e->sched_time<sim_time) return;
-
-	Event **ppcur = &head;
-	while ((*ppcur!=NULL) && ((*ppcur)->sched_time<=e->sched_time))
-	    ppcur = &((*ppcur)->next);
-
-	e->next = *ppcur;
-	*ppcur = e;
-    }
-
-    /* cancel an event scheduled for happening in the future */
-    void cancel(Event *e) {
-	Event **ppcur = &head;
-	while ((*ppcur!=NULL) && (*ppcur!=e))
-	    ppcur = &((*ppcur)->next);
-
-	if (*ppcur==e) *ppcur=(*ppcur)->next;
-    }
-
-    /* advance to the next event */
-    Event *next_event() {
-	if (head==NULL) return NULL;
-
-	Event *e = head;
-	head = head->next;
-	sim_time = e->sched_time;
-
-	return e;
-    }
-};
+#include "rdt_linktrace.h"
+#include "rdt_evtrace.h"
+#include "rdt_stats.h"
+#include "rdt_upper.h"
+#include "rdt_event.h"
+#include "rdt_spsc.h"
 
 
 /*[]------------------------------------------------------------------------[]
@@ -91,14 +40,21 @@ public:
   []------------------------------------------------------------------------[]*/
 
 enum {EVENT_SENDER_FROMUPPERLAYER=0, EVENT_SENDER_FROMLOWERLAYER, 
-      EVENT_SENDER_TIMEOUT, EVENT_RECEIVER_FROMLOWERLAYER};
+      EVENT_SENDER_TIMEOUT, EVENT_RECEIVER_FROMUPPERLAYER, 
+      EVENT_RECEIVER_FROMLOWERLAYER, EVENT_RECEIVER_TIMEOUT};
+
+/* the two sides of a flow */
+enum {SIDE_SENDER=0, SIDE_RECEIVER};
+static const char *side_name[2] = {"Sender", "Receiver"};
 
 /* the event that the upper layer at the sender instructs rdt layer to send out 
-   a message */
+   a message of a flow */
 class EventSenderFromUpperLayer : public Event
 {
 public:
-    EventSenderFromUpperLayer() { event_type = EVENT_SENDER_FROMUPPERLAYER; }
+    unsigned int flow;
+public:
+    EventSenderFromUpperLayer(unsigned int f) { event_type = EVENT_SENDER_FROMUPPERLAYER; flow = f; }
 };
 
 /* the event that the lower layer at the sender informs the rdt layer that a 
@@ -111,11 +67,23 @@ public:
     EventSenderFromLowerLayer() { event_type = EVENT_SENDER_FROMLOWERLAYER; }
 };
 
-/* the event that the timer at the sender expires */
+/* the event that the timer of a flow at the sender expires */
 class EventSenderTimeout : public Event
 {
 public:
-    EventSenderTimeout() { event_type = EVENT_SENDER_TIMEOUT; }
+    unsigned int flow;
+public:
+    EventSenderTimeout(unsigned int f) { event_type = EVENT_SENDER_TIMEOUT; flow = f; }
+};
+
+/* the event that the upper layer at the receiver instructs rdt layer to send 
+   out a message of a flow back to the sender */
+class EventReceiverFromUpperLayer : public Event
+{
+public:
+    unsigned int flow;
+public:
+    EventReceiverFromUpperLayer(unsigned int f) { event_type = EVENT_RECEIVER_FROMUPPERLAYER; flow = f; }
 };
 
 /* the event that the lower layer at the receiver informs the rdt layer that a 
@@ -128,6 +96,15 @@ public:
     EventReceiverFromLowerLayer() { event_type = EVENT_RECEIVER_FROMLOWERLAYER; }
 };
 
+/* the event that the timer of a flow at the receiver expires */
+class EventReceiverTimeout : public Event
+{
+public:
+    unsigned int flow;
+public:
+    EventReceiverTimeout(unsigned int f) { event_type = EVENT_RECEIVER_TIMEOUT; flow = f; }
+};
+
 
 /*[]------------------------------------------------------------------------[]
   |  gloabal variables, statistics, etc.
@@ -163,23 +140,95 @@ double corrupt_rate;
 /* tracing levels (higher level always prints out more information):
    a tracing level of 0 turns off all traces while a tracing, 
    a tracing level of 1 turns on regular traces,
-   a tracing level of 2 prints out the delivered message
+   a tracing level of 2 prints out the delivered message in hex
+   with -b, the regular traces are recorded in binary instead of printed out
 */
 int tracing_level;
 
-/* simulation event chain core */
-EventChain sim_core;
+/* number of flows, each with its own message arrivals, sender and receiver */
+unsigned int n_flows = 1;
+
+/* number of worker threads, each simulating a contiguous block of flows */
+unsigned int n_workers = 1;
+
+/* whether the receiver sends messages back to the sender as well */
+bool duplex = false;
+
+/* budgets after which the run is cut short, 0 for none: wall-clock seconds,
+   and events simulated, split evenly among the threads */
+double wall_budget = 0;
+unsigned long long event_budget = 0;
+
+/* set by the main thread when the wall-clock budget runs out */
+bool stop_shards = false;
+
+/* timer events of the sender and the receiver, indexed by flow */
+std::vector<Event *> timers[2];
+
+/* the number of sides of a flow still generating messages, FLOW_REPORTED 
+   once its completion was reported, indexed by flow */
+#define FLOW_REPORTED -1
+std::vector<int> flow_state;
+
+/* the time the last side of a flow stopped generating messages */
+std::vector<double> flow_stopped;
+
+/* a flow all of whose messages were delivered, reported to the main thread */
+struct flow_done {
+    unsigned int flow;
+    double time;
+    double drain;           /* since its messages stopped */
+};
+
+/* a shard simulates its flows in a thread with an event chain, a random
+   number generator and packet event pools of its own.  both ends of a flow
+   live in the same shard, so the shards share no state on the data path;
+   the per-flow tables are shared but every entry is only touched by the
+   shard of its flow.  the flows of a shard are numbered consecutively, so
+   neighbouring entries belong to the same shard except at the ends of
+   its block */
+struct shard {
+    unsigned int first_flow;    /* the shard simulates the flows from */
+    unsigned int end_flow;      /* first_flow up to but excluding end_flow */
+    pthread_t thread;
+
+    /* simulation event chain core */
+    EventChain core;
+
+    /* rand_r() state */
+    unsigned int rng;
+
+    /* packet events reused instead of allocated for every packet */
+    std::vector<EventSenderFromLowerLayer *> sender_pkt_pool;
+    std::vector<EventReceiverFromLowerLayer *> receiver_pkt_pool;
+
+    /* completed flows, consumed by the main thread */
+    SpscQueue<flow_done> *done_queue;
+
+    /* the events the shard may simulate */
+    unsigned long long event_budget;
+
+    /* set once the shard ran out of events, the results below are valid 
+       from then on */
+    bool finished;
+    bool cut_short;         /* stopped with events left */
+    struct rdt_stats stats;
+    unsigned long long chars_sent;
+    unsigned long long chars_delivered;
+    unsigned long long pkts_passed;
+};
+
+std::vector<shard *> shards;
 
-/* sender timer event */
-Event *sender_timer = NULL;
+/* the shard run by the calling thread */
+static thread_local shard *cur_shard = NULL;
 
-/* general statistics */
-int tot_chars_sent = 0;
-int tot_chars_delivered = 0;
-int tot_pkts_passed = 0;
+/* simulation time outside the shards: 0 before they start and the time
+   the last one finished afterwards */
+double main_time = 0;
 
-/* error flag set by message verification at the receiver */
-bool message_verfication_passed = true;
+/* general statistics, per thread */
+thread_local unsigned long long tot_pkts_passed = 0;
 
 
 /*[]------------------------------------------------------------------------[]
@@ -189,162 +238,419 @@ bool message_verfication_passed = true;
 /* generate a random number in [0,1] */
 static double myrandom()
 {
-    return(rand()*1.0/RAND_MAX);
+    return(rand_r(&cur_shard->rng)*1.0/RAND_MAX);
 }
 
-/* generate a message 
-   NOTE: change this part if you want to generate different messages for 
-         testing.  we will certainly use different messages in our grading! */
-static struct message *generate_msg()
+/* the payload stream a side of a flow sends */
+static unsigned int stream_of(int side, unsigned int flow)
 {
-    static char cnt = 0;
-
-    struct message *msg = (struct message*) malloc(sizeof(struct message));
-    ASSERT(msg!=NULL);
-    msg->size = (int)(myrandom()*2.0*msg_size);
-    if (msg->size==0) msg->size=1;
-    msg->data = (char*) malloc(msg->size);
-    ASSERT(msg->data!=NULL);
-
-    for (int i=0; i<msg->size; i+=1) {
-	msg->data[i] = '0' + cnt;
-	cnt = (cnt+1) % 10;
-    }
-
-    tot_chars_sent += msg->size;
+    return side==SIDE_SENDER ? flow : n_flows+flow;
+}
 
-    return msg;
+/* generate a message of a side of a flow
+   NOTE: change upper_generate() if you want to generate different messages 
+         for testing.  we will certainly use different messages in our grading! */
+static struct message *generate_msg(int side, unsigned int flow)
+{
+    int size = (int)(myrandom()*2.0*msg_size);
+    if (size==0) size=1;
+    return upper_generate(stream_of(side, flow), size, cur_shard->core.time());
 }
 
 /* free the space of a message */
 static void free_msg(struct message *msg)
 {
-    if (msg->data!=NULL) free(msg->data);
-    if (msg!=NULL) free(msg);
+    upper_free(msg);
 }
 
 /* get simulation time (in seconds) - for both the sender and the receiver */
 double GetSimulationTime()
 {
-    return sim_core.time();
+    return cur_shard!=NULL ? cur_shard->core.time() : main_time;
+}
+
+/* cancel the timer of a side of a flow if it is set */
+static void cancel_timer(int side, unsigned int flow)
+{
+    Event *e = timers[side][flow];
+    if (e!=NULL) {
+	cur_shard->core.cancel(e);
+	delete e;
+	timers[side][flow] = NULL;
+    }
+}
+
+/* start the timer of a side of a flow, replacing the one that is set */
+static void start_timer(int side, unsigned int flow, double timeout)
+{
+    if (evtrace_enabled)
+	evtrace(cur_shard->core.time(), EV_TIMER_START, side, flow, 
+		(unsigned int)(timeout*1000000.0), 0, 0);
+    else if (tracing_level>=1)
+	fprintf(stdout, "Time %.2fs (%s): the timer of flow %u is started (expires at %.2fs).\n",
+		cur_shard->core.time(), side_name[side], flow, cur_shard->core.time() + timeout);
+
+    cancel_timer(side, flow);
+
+    Event *e;
+    if (side==SIDE_SENDER)
+	e = new EventSenderTimeout(flow);
+    else
+	e = new EventReceiverTimeout(flow);
+    e->sched_time = cur_shard->core.time() + timeout;
+    cur_shard->core.schedule(e);
+
+    timers[side][flow] = e;
+}
+
+/* stop the timer of a side of a flow */
+static void stop_timer(int side, unsigned int flow)
+{
+    if (evtrace_enabled)
+	evtrace(cur_shard->core.time(), EV_TIMER_STOP, side, flow, 0, 0, 0);
+    else if (tracing_level>=1)
+	fprintf(stdout, "Time %.2fs (%s): the timer of flow %u is stopped.\n", 
+		cur_shard->core.time(), side_name[side], flow);
+
+    cancel_timer(side, flow);
 }
 
-/* start the sender timer with a specified timeout (in seconds).
+/* start the sender timer of a flow with a specified timeout (in seconds).
    the timer is cancelled with Sender_StopTimer() is called or a new 
    Sender_StartTimer() is called before the current timer expires.
    Sender_Timeout() will be called when the timer expires. */
-void Sender_StartTimer(double timeout)
+void Sender_StartTimer(unsigned int flow, double timeout)
 {
-    if (tracing_level>=1)
-	fprintf(stdout, "Time %.2fs (Sender): the timer is started (expires at %.2fs).\n",
-		sim_core.time(), sim_core.time() + timeout);
+    start_timer(SIDE_SENDER, flow, timeout);
+}
 
-    if (sender_timer!=NULL) {
-	sim_core.cancel(sender_timer);
-	delete sender_timer;
-	sender_timer = NULL;
-    }
+/* stop the sender timer of a flow */
+void Sender_StopTimer(unsigned int flow)
+{
+    stop_timer(SIDE_SENDER, flow);
+}
+
+/* check whether the sender timer of a flow is being set,
+   return true if the timer is set, return false otherwise */
+bool Sender_isTimerSet(unsigned int flow)
+{
+    return (timers[SIDE_SENDER][flow]!=NULL);
+}
+
+/* the receiver timer works the same way, Receiver_Timeout() is called when 
+   it expires */
+void Receiver_StartTimer(unsigned int flow, double timeout)
+{
+    start_timer(SIDE_RECEIVER, flow, timeout);
+}
+
+void Receiver_StopTimer(unsigned int flow)
+{
+    stop_timer(SIDE_RECEIVER, flow);
+}
 
-    EventSenderTimeout *e = new EventSenderTimeout;
-    e->sched_time = sim_core.time() + timeout;
-    sim_core.schedule(e);
+bool Receiver_isTimerSet(unsigned int flow)
+{
+    return (timers[SIDE_RECEIVER][flow]!=NULL);
+}
 
-    sender_timer = e;
+/* take an event from a pool, or allocate a new one if it is empty */
+template <class T>
+static T *pool_get(std::vector<T *> &pool)
+{
+    if (pool.empty()) return new T;
+    T *e = pool.back();
+    pool.pop_back();
+    return e;
 }
 
-/* stop the sender timer */
-void Sender_StopTimer()
+template <class T>
+static void pool_free(std::vector<T *> &pool)
 {
-    if (tracing_level>=1)
-	fprintf(stdout, "Time %.2fs (Sender): the timer is stopped.\n", 
-		sim_core.time());
+    for (unsigned int i=0; i<pool.size(); i++)
+	delete pool[i];
+    pool.clear();
+}
 
-    if (sender_timer!=NULL) {
-	sim_core.cancel(sender_timer);
-	delete sender_timer;
-	sender_timer = NULL;
+/* report a flow to the main thread once both sides stopped generating 
+   messages and everything they generated was delivered */
+static void check_flow_done(unsigned int flow)
+{
+    if (flow_state[flow]!=0 || !upper_drained(stream_of(SIDE_SENDER, flow)) ||
+	(duplex && !upper_drained(stream_of(SIDE_RECEIVER, flow))))
+	return;
+
+    flow_done d;
+    d.flow = flow;
+    d.time = cur_shard->core.time();
+    d.drain = d.time - flow_stopped[flow];
+    /* the queue has room for every flow of the shard */
+    cur_shard->done_queue->push(d);
+    flow_state[flow] = FLOW_REPORTED;
+}
+
+/* decide the fate of a packet sent in direction dir, either from the link 
+   trace or at random: returns false if the packet is lost, otherwise sets its 
+   one-way latency and whether it gets corrupted */
+static bool link_fate(int dir, double *latency, bool *corrupt)
+{
+    if (linktrace_active()) {
+	const struct link_record *r = linktrace_next(dir);
+	if (r->flags & LINKTRACE_LOST) return false;
+	*latency = r->delay_us / 1000000.0;
+	*corrupt = (r->flags & LINKTRACE_CORRUPT) != 0;
+	return true;
     }
+
+    /* packet lost at rate "loss_rate" */
+    if (myrandom()<loss_rate) return false;
+
+    /* packet corrupted at rate "corrupt_rate" */
+    *corrupt = myrandom()<corrupt_rate;
+
+    if (myrandom()<outoforder_rate)
+	*latency = pkt_latency*2.0*myrandom();
+    else
+	*latency = pkt_latency;
+    return true;
 }
 
-/* check whether the sender timer is being set,
-   return true if the timer is set, return false otherwise */
-bool Sender_isTimerSet()
+/* garble a packet, note that any part of the packet can be corrupted */
+static void corrupt_packet(struct packet *pkt)
 {
-    return (sender_timer!=NULL);
+    for (int i=0; i<RDT_PKTSIZE; i++) {
+	pkt->data[i] = pkt->data[i] + (char)(myrandom()*20) - 10;
+    }
 }
 
 /* pass a packet to the lower layer at the sender */
 void Sender_ToLowerLayer(struct packet *pkt)
 {
-    /* packet lost at rate "loss_rate" */
-    if (myrandom()<loss_rate) return;
+    double latency;
+    bool corrupt;
+    if (!link_fate(LINK_FORWARD, &latency, &corrupt)) return;
 
-    EventReceiverFromLowerLayer *e = new EventReceiverFromLowerLayer;
+    EventReceiverFromLowerLayer *e = pool_get(cur_shard->receiver_pkt_pool);
     memcpy(&e->pkt.data, pkt->data, RDT_PKTSIZE);
-
-    /* packet corrupted at rate "corrupt_rate" */
-    if (myrandom()<corrupt_rate) {
-	for (int i=0; i<RDT_PKTSIZE; i++) {
-	    e->pkt.data[i] = e->pkt.data[i] + (char)(myrandom()*20) - 10;
-	}
-    }
+    if (corrupt) corrupt_packet(&e->pkt);
 
     /* schedule the packet arrival event at the other side */
-    if (myrandom()<outoforder_rate)
-	e->sched_time = sim_core.time() + pkt_latency*2.0*myrandom();
-    else
-	e->sched_time = sim_core.time() + pkt_latency;
-    sim_core.schedule(e);
+    e->sched_time = cur_shard->core.time() + latency;
+    cur_shard->core.schedule(e);
 
     tot_pkts_passed ++;
 }
 
 
+/* pass n packets to the lower layer at the sender at once */
+void Sender_ToLowerLayerBatch(struct packet **pkts, int n)
+{
+    for (int i=0; i<n; i++)
+	Sender_ToLowerLayer(pkts[i]);
+}
+
 /* pass a packet to the lower layer at the receiver */
 void Receiver_ToLowerLayer(struct packet *pkt)
 {
-    /* packet lost at rate "loss_rate" */
-    if (myrandom()<loss_rate) return;
+    double latency;
+    bool corrupt;
+    if (!link_fate(LINK_REVERSE, &latency, &corrupt)) return;
 
-    EventSenderFromLowerLayer *e = new EventSenderFromLowerLayer;
+    EventSenderFromLowerLayer *e = pool_get(cur_shard->sender_pkt_pool);
     memcpy(&e->pkt.data, pkt->data, RDT_PKTSIZE);
-
-    /* packet corrupted at rate "corrupt_rate" */
-    if (myrandom()<corrupt_rate) {
-	for (int i=0; i<RDT_PKTSIZE; i++) {
-	    e->pkt.data[i] = e->pkt.data[i] + (char)(myrandom()*20) - 10;
-	}
-    }
+    if (corrupt) corrupt_packet(&e->pkt);
 
     /* schedule the packet arrival event at the other side */
-    if (myrandom()<outoforder_rate)
-	e->sched_time = sim_core.time() + pkt_latency*2.0*myrandom();
-    else
-	e->sched_time = sim_core.time() + pkt_latency;	
-    sim_core.schedule(e);
+    e->sched_time = cur_shard->core.time() + latency;
+    cur_shard->core.schedule(e);
 
     tot_pkts_passed ++;
 }
 
-/* deliver a message to the upper layer at the receiver 
-   NOTE: change the message verification in this function if you changed 
-         generate_msg() for testing. */
-void Receiver_ToUpperLayer(struct message *msg)
+/* deliver a message of a side of a flow to the upper layer at the other 
+   side
+   NOTE: the messages are verified by upper_deliver(). */
+static void deliver_msg(int side, unsigned int flow, struct message *msg)
 {
-    static char cnt = 0;
+    if (tracing_level>=2) {
+	for (int i=0; i<msg->size; i++)
+	    fprintf(stdout, "%02x", (unsigned char)msg->data[i]);
+	fputc('\n', stdout);
+    }
 
-    for (int i=0; i<msg->size; i++) {
-	/* message verification */
-	if (msg->data[i] != '0' + cnt) {
-	    message_verfication_passed = false;
+    upper_deliver(stream_of(side, flow), msg, cur_shard->core.time());
+    check_flow_done(flow);
+}
+
+/* deliver a message to the upper layer at the receiver */
+void Receiver_ToUpperLayer(unsigned int flow, struct message *msg)
+{
+    deliver_msg(SIDE_SENDER, flow, msg);
+}
+
+/* deliver a message sent back by the receiver to the upper layer at the 
+   sender */
+void Sender_ToUpperLayer(unsigned int flow, struct message *msg)
+{
+    deliver_msg(SIDE_RECEIVER, flow, msg);
+}
+
+
+/* drop the events left in the chain of a shard that was cut short */
+static void discard_events(shard *sh)
+{
+    for (unsigned int i=sh->first_flow; i<sh->end_flow; i++) {
+	cancel_timer(SIDE_SENDER, i);
+	cancel_timer(SIDE_RECEIVER, i);
+    }
+    Event *e;
+    while ((e = sh->core.peek())!=NULL) {
+	sh->core.cancel(e);
+	delete e;
+    }
+}
+
+/* the event loop of a shard, run in a thread of its own */
+static void *run_shard(void *arg)
+{
+    shard *sh = (shard *)arg;
+    cur_shard = sh;
+    stats_init();
+    evtrace_thread_init();
+
+    /* scheduling a recurring message arrival event for every flow of the 
+       shard */
+    for (unsigned int i=sh->first_flow; i<sh->end_flow; i++) {
+	EventSenderFromUpperLayer *e = new EventSenderFromUpperLayer(i);
+	e->sched_time = 0;
+	cur_shard->core.schedule(e);
+	if (duplex) {
+	    EventReceiverFromUpperLayer *r = new EventReceiverFromUpperLayer(i);
+	    r->sched_time = 0;
+	    cur_shard->core.schedule(r);
 	}
-	cnt = (cnt+1) % 10;
+    }
+
+    /* main simulation cycle */
+    for (;;) {
+	if (stats.events==sh->event_budget ||
+	    __atomic_load_n(&stop_shards, __ATOMIC_RELAXED)) {
+	    sh->cut_short = !sh->core.empty();
+	    break;
+	}
+	Event *e = sh->core.next_event();
+	if (e==NULL) break;
+	stats.events++;
+
+	switch (e->event_type) {
+	case EVENT_SENDER_FROMUPPERLAYER:
+	case EVENT_RECEIVER_FROMUPPERLAYER:
+	    {
+		int side = e->event_type==EVENT_SENDER_FROMUPPERLAYER ? SIDE_SENDER : SIDE_RECEIVER;
+		unsigned int flow = side==SIDE_SENDER ? ((EventSenderFromUpperLayer*) e)->flow :
+		    ((EventReceiverFromUpperLayer*) e)->flow;
+
+		if (evtrace_enabled)
+		    evtrace(cur_shard->core.time(), EV_UPPER_MESSAGE, side, flow, 0, 0, 0);
+		else if (tracing_level>=1)
+		    fprintf(stdout, "Time %.2fs (%s): the upper layer instructs rdt layer to send out a message of flow %u.\n", cur_shard->core.time(), side_name[side], flow);
+
+		struct message *msg = generate_msg(side, flow);
+		if (side==SIDE_SENDER)
+		    Sender_FromUpperLayer(flow, msg);
+		else
+		    Receiver_FromUpperLayer(flow, msg);
+		free_msg(msg);
+
+		/* schedule the recurring event */
+		if (cur_shard->core.time() < sim_time) {
+		    e->sched_time = 
+			cur_shard->core.time() + msg_arrivalint*2.0*myrandom();
+		    cur_shard->core.schedule(e);
+		}
+		else {
+		    if (--flow_state[flow]==0)
+			flow_stopped[flow] = cur_shard->core.time();
+		    if (side==SIDE_SENDER)
+			Sender_Drain(flow);
+		    else
+			Receiver_Drain(flow);
+		    check_flow_done(flow);
+		    delete e;
+		}
+	    }
+	    break;
+
+	case EVENT_SENDER_FROMLOWERLAYER:
+	    {
+		if (evtrace_enabled)
+		    evtrace(cur_shard->core.time(), EV_SENDER_PACKET, SIDE_SENDER, EVTRACE_NO_FLOW, 0, 0, 0);
+		else if (tracing_level>=1)
+		    fprintf(stdout, "Time %.2fs (Sender): the lower layer informs the rdt layer that a packet is received from the link.\n", cur_shard->core.time());
+
+		EventSenderFromLowerLayer *real_e = (EventSenderFromLowerLayer*) e;
+
+		Sender_FromLowerLayer(&real_e->pkt);
+
+		sh->sender_pkt_pool.push_back(real_e);
+	    }
+	    break;
+
+	case EVENT_SENDER_TIMEOUT:
+	case EVENT_RECEIVER_TIMEOUT:
+	    {
+		int side = e->event_type==EVENT_SENDER_TIMEOUT ? SIDE_SENDER : SIDE_RECEIVER;
+		unsigned int flow = side==SIDE_SENDER ? ((EventSenderTimeout*) e)->flow :
+		    ((EventReceiverTimeout*) e)->flow;
+
+		if (evtrace_enabled)
+		    evtrace(cur_shard->core.time(), EV_TIMEOUT, side, flow, 0, 0, 0);
+		else if (tracing_level>=1)
+		    fprintf(stdout, "Time %.2fs (%s): the timer of flow %u expires.\n", cur_shard->core.time(), side_name[side], flow);
+
+		delete e;
+		timers[side][flow] = NULL;
 
-	if (tracing_level>=2)
-	    fputc(msg->data[i], stdout);
+		if (side==SIDE_SENDER)
+		    Sender_Timeout(flow);
+		else
+		    Receiver_Timeout(flow);
+	    }
+	    break;
+
+	case EVENT_RECEIVER_FROMLOWERLAYER:
+	    {
+		if (evtrace_enabled)
+		    evtrace(cur_shard->core.time(), EV_RECEIVER_PACKET, SIDE_RECEIVER, EVTRACE_NO_FLOW, 0, 0, 0);
+		else if (tracing_level>=1)
+		    fprintf(stdout, "Time %.2fs (Receiver): the lower layer informs the rdt layer that a packet is received from the link.\n", cur_shard->core.time());
+
+		EventReceiverFromLowerLayer *real_e = (EventReceiverFromLowerLayer*) e;
+		
+		Receiver_FromLowerLayer(&real_e->pkt);
+
+		sh->receiver_pkt_pool.push_back(real_e);
+	    }
+	    break;
+
+	default:
+	    fprintf(stderr, "undefined event %d\n", e->event_type);
+	    break;
+	}
     }
 
-    tot_chars_delivered += msg->size;
+    if (sh->cut_short) discard_events(sh);
+    pool_free(sh->sender_pkt_pool);
+    pool_free(sh->receiver_pkt_pool);
+    evtrace_flush();
+
+    /* hand the results over to the main thread */
+    sh->stats = stats;
+    sh->chars_sent = tot_chars_sent;
+    sh->chars_delivered = tot_chars_delivered;
+    sh->pkts_passed = tot_pkts_passed;
+    __atomic_store_n(&sh->finished, true, __ATOMIC_RELEASE);
+    return NULL;
 }
 
 
@@ -354,12 +660,75 @@ void Receiver_ToUpperLayer(struct message *msg)
 
 int main(int argc, char *argv[])
 {
-    if (argc!=8) {
-	fprintf(stderr, "usage: %s <sim_time> <mean_msg_arrivalint> <mean_msg_size> "
+    const char *linktrace_path = NULL;
+    const char *evtrace_path = NULL;
+    const char *stats_path = NULL;
+    bool seeded = false;
+    unsigned int seed = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "+b:dE:f:j:s:t:w:W:")) != -1) {
+	switch (opt) {
+	case 'b':
+	    evtrace_path = optarg;
+	    break;
+	case 'd':
+	    duplex = true;
+	    break;
+	case 'E':
+	    event_budget = strtoull(optarg, NULL, 0);
+	    break;
+	case 'f':
+	    n_flows = strtoul(optarg, NULL, 0);
+	    break;
+	case 'j':
+	    stats_path = optarg;
+	    break;
+	case 's':
+	    seed = strtoul(optarg, NULL, 0);
+	    seeded = true;
+	    break;
+	case 't':
+	    linktrace_path = optarg;
+	    break;
+	case 'w':
+	    n_workers = strtoul(optarg, NULL, 0);
+	    break;
+	case 'W':
+	    wall_budget = atof(optarg);
+	    break;
+	default:
+	    argc = 0;
+	    break;
+	}
+    }
+    if (argc-optind!=7) {
+	fprintf(stderr, "usage: %s [-b <event_trace>] [-d] [-E <event_budget>] [-f <flows>] "
+		"[-j <stats_json>] [-s <seed>] [-t <link_trace>] [-w <threads>] "
+		"[-W <wall_clock_budget>] <sim_time> "
+		"<mean_msg_arrivalint> <mean_msg_size> "
 		"<outoforder_rate> <loss_rate> <corrupt_rate> <tracing_level>\n", 
 		argv[0]);
 	exit(-1);
     }
+    argv += optind-1;
+    if (n_flows==0) {
+	fprintf(stderr, "invalid <flows>\n");
+	exit(-1);
+    }
+    if (n_workers==0) {
+	fprintf(stderr, "invalid <threads>\n");
+	exit(-1);
+    }
+    if (wall_budget<0) {
+	fprintf(stderr, "invalid <wall_clock_budget>\n");
+	exit(-1);
+    }
+    /* a shard without flows would have nothing to do */
+    if (n_workers>n_flows) n_workers = n_flows;
+    if (linktrace_path!=NULL && n_workers>1) {
+	fprintf(stderr, "a link trace is replayed by one thread only\n");
+	exit(-1);
+    }
 
     sim_time = atof(argv[1]);
     if (sim_time<=0) {
@@ -372,7 +741,7 @@ int main(int argc, char *argv[])
 	exit(-1);
     }
     msg_size = atoi(argv[3]);
-    if (msg_size<=0) {
+    if (msg_size<=0 || msg_size>INT_MAX/2) {
 	fprintf(stderr, "invalid <msg_size>\n");
 	exit(-1);
     }
@@ -404,19 +773,40 @@ int main(int argc, char *argv[])
 	    "\taverage out-of-order delivery rate is %.2f%%\n"
 	    "\taverage loss rate is %.2f%%\n"
 	    "\taverage corrupt rate is %.2f%%\n"
-	    "\ttracing level is %d\n"
-	    "Please review these inputs and press <enter> to proceed.\n",
+	    "\ttracing level is %d\n",
 	    sim_time, msg_arrivalint, msg_size, outoforder_rate*100.0, 
 	    loss_rate*100.0, corrupt_rate*100.0, tracing_level);
+    if (n_flows>1)
+	fprintf(stdout, "\t%u flows, each with the above message arrivals\n", n_flows);
+    if (duplex)
+	fprintf(stdout, "\tthe receiver sends messages back with the same arrivals\n");
+    if (n_workers>1)
+	fprintf(stdout, "\tflows are simulated by %u threads\n", n_workers);
+    if (linktrace_path!=NULL) {
+	if (!linktrace_open(linktrace_path)) exit(-1);
+	fprintf(stdout, "\tlink trace %s replaces the loss, corrupt and "
+		"out-of-order rates\n", linktrace_path);
+    }
+    if (evtrace_path!=NULL && tracing_level>=1) {
+	if (!evtrace_open(evtrace_path)) exit(-1);
+	fprintf(stdout, "\tevents are traced to %s\n", evtrace_path);
+    }
+    if (wall_budget>0)
+	fprintf(stdout, "\tthe run is cut short after %.3f seconds of wall-clock time\n", wall_budget);
+    if (event_budget>0)
+	fprintf(stdout, "\tthe run is cut short after %llu events\n", event_budget);
+    if (seeded)
+	fprintf(stdout, "\trandom seed is %u\n", seed);
+    fprintf(stdout, "Please review these inputs and press <enter> to proceed.\n");
     fgetc(stdin);
 
     /* initialize the random number generator */
-    srand(getpid()+getppid());
+    srand(seeded ? seed : getpid()+getppid());
 
     /* test the random number generator */
     double randtest_sum = 0.0;
     for (int i=0; i<1000; i++)
-	randtest_sum += myrandom();
+	randtest_sum += rand()*1.0/RAND_MAX;
     double randtest_avg = randtest_sum/1000;
     if (randtest_avg<0.25 || randtest_avg>0.75) {
 	fprintf(stderr, 
@@ -426,107 +816,113 @@ int main(int argc, char *argv[])
 	exit(-1);
     }
 
-    /* intialize the sender and the receiver */
-    Sender_Init();
-    Receiver_Init();
+    stats_init();
+    upper_init(((unsigned long long)rand()<<32) ^ rand(), duplex ? 2*n_flows : n_flows);
+    timers[SIDE_SENDER].assign(n_flows, (Event *)NULL);
+    timers[SIDE_RECEIVER].assign(n_flows, (Event *)NULL);
+    flow_state.assign(n_flows, duplex ? 2 : 1);
+    flow_stopped.assign(n_flows, 0);
 
-    /* scheduling a recurring message arrival event */
-    EventSenderFromUpperLayer *e = new EventSenderFromUpperLayer;
-    e->sched_time = 0;
-    sim_core.schedule(e);
+    /* intialize the sender and the receiver */
+    Sender_Init(n_flows);
+    Receiver_Init(n_flows);
+
+    /* start the shards, each with a random number generator of its own */
+    for (unsigned int i=0; i<n_workers; i++) {
+	shard *sh = new shard;
+	sh->first_flow = (unsigned long long)n_flows*i/n_workers;
+	sh->end_flow = (unsigned long long)n_flows*(i+1)/n_workers;
+	sh->rng = rand();
+	sh->done_queue = new SpscQueue<flow_done>(sh->end_flow-sh->first_flow);
+	sh->event_budget = event_budget/n_workers + (i<event_budget%n_workers);
+	if (event_budget==0) sh->event_budget = ULLONG_MAX;
+	sh->finished = false;
+	sh->cut_short = false;
+	shards.push_back(sh);
+    }
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (unsigned int i=0; i<n_workers; i++) {
+	if (pthread_create(&shards[i]->thread, NULL, run_shard, shards[i])!=0) {
+	    fprintf(stderr, "cannot create thread %u\n", i);
+	    exit(-1);
+	}
+    }
 
-    /* main simulation cycle */
+    /* collect the completed flows until every shard is done */
     for (;;) {
-	Event *e = sim_core.next_event();
-	if (e==NULL) break;
-
-	switch (e->event_type) {
-	case EVENT_SENDER_FROMUPPERLAYER:
-	    {
-		if (tracing_level>=1) {
-		    fprintf(stdout, "Time %.2fs (Sender): the upper layer instructs rdt layer to send out a message.\n", sim_core.time());
-		}
-
-		EventSenderFromUpperLayer *real_e = (EventSenderFromUpperLayer*) e;
-
-		struct message *msg = generate_msg();
-		Sender_FromUpperLayer(msg);
-		free_msg(msg);
-
-		/* schedule the recurring event */
-		if (sim_core.time() < sim_time) {
-		    real_e->sched_time = 
-			sim_core.time() + msg_arrivalint*2.0*myrandom();
-		    sim_core.schedule(real_e);
-		}
-		else
-		    delete real_e;
+	unsigned int running = 0;
+	for (unsigned int i=0; i<n_workers; i++)
+	    if (!__atomic_load_n(&shards[i]->finished, __ATOMIC_ACQUIRE)) running++;
+
+	unsigned int collected = 0;
+	flow_done d;
+	for (unsigned int i=0; i<n_workers; i++) {
+	    while (shards[i]->done_queue->pop(&d)) {
+		hist_record(&stats.completion_us, (unsigned long long)(d.time*1000000.0));
+		hist_record(&stats.drain_us, (unsigned long long)(d.drain*1000000.0));
+		collected++;
 	    }
-	    break;
-
-	case EVENT_SENDER_FROMLOWERLAYER:
-	    {
-		if (tracing_level>=1) {
-		    fprintf(stdout, "Time %.2fs (Sender): the lower layer informs the rdt layer that a packet is received from the link.\n", sim_core.time());
-		}
-
-		EventSenderFromLowerLayer *real_e = (EventSenderFromLowerLayer*) e;
-
-		Sender_FromLowerLayer(&real_e->pkt);
-
-		delete real_e;
-	    }
-	    break;
-
-	case EVENT_SENDER_TIMEOUT:
-	    {
-		if (tracing_level>=1) {
-		    fprintf(stdout, "Time %.2fs (Sender): the timer expires.\n", sim_core.time());
-		}
-
-		EventSenderTimeout *real_e = (EventSenderTimeout*) e;
-		delete real_e;
-		sender_timer = NULL;
-
-		Sender_Timeout();
-	    }
-	    break;
-
-	case EVENT_RECEIVER_FROMLOWERLAYER:
-	    {
-		if (tracing_level>=1) {
-		    fprintf(stdout, "Time %.2fs (Receiver): the lower layer informs the rdt layer that a packet is received from the link.\n", sim_core.time());
-		}
-
-		EventReceiverFromLowerLayer *real_e = (EventReceiverFromLowerLayer*) e;
-		
-		Receiver_FromLowerLayer(&real_e->pkt);
-
-		delete real_e;
+	}
+	if (running==0) break;
+
+	if (wall_budget>0 && stats.cut_short==NULL) {
+	    struct timespec now;
+	    clock_gettime(CLOCK_MONOTONIC, &now);
+	    if (now.tv_sec-start.tv_sec + (now.tv_nsec-start.tv_nsec)/1e9 > wall_budget) {
+		stats.cut_short = "wall-clock";
+		__atomic_store_n(&stop_shards, true, __ATOMIC_RELAXED);
 	    }
-	    break;
-
-	default:
-	    fprintf(stderr, "undefined event %d\n", e->event_type);
-	    break;
 	}
+	if (collected==0) usleep(1000);
+    }
+
+    /* gather the results of the shards */
+    for (unsigned int i=0; i<n_workers; i++) {
+	shard *sh = shards[i];
+	pthread_join(sh->thread, NULL);
+	stats_merge(&stats, &sh->stats);
+	tot_chars_sent += sh->chars_sent;
+	tot_chars_delivered += sh->chars_delivered;
+	tot_pkts_passed += sh->pkts_passed;
+	if (sh->core.time()>main_time) main_time = sh->core.time();
+	if (sh->cut_short && stats.cut_short==NULL) stats.cut_short = "event";
+	delete sh->done_queue;
+	delete sh;
     }
+    shards.clear();
 
     /* finalize the sender and the receiver */
     Sender_Final();
     Receiver_Final();
+    linktrace_close();
+    evtrace_close();
 
     fprintf(stdout, "\n");
     fprintf(stdout, "## Simulation completed at time %.2fs with\n" 
-	    "\t%d characters sent\n" 
-	    "\t%d characters delivered\n"
-	    "\t%d packets passed between the sender and the receiver\n", 
-	    sim_core.time(), tot_chars_sent, tot_chars_delivered, tot_pkts_passed);
-
-    if (message_verfication_passed && (tot_chars_sent==tot_chars_delivered))
-	fprintf(stdout, "## Congratulations! This session is error-free, loss-free, and in order.\n");
-    else
-	fprintf(stdout, "## Something is wrong! This session is NOT error-free, loss-free, and in order.\n");
+	    "\t%llu characters sent\n" 
+	    "\t%llu characters delivered\n"
+	    "\t%llu packets passed between the sender and the receiver\n", 
+	    main_time, tot_chars_sent, tot_chars_delivered, tot_pkts_passed);
+
+    if (stats.cut_short!=NULL)
+	fprintf(stdout, "## The %s budget ran out, messages still on their way were not delivered.\n",
+		stats.cut_short);
+    upper_report(stdout);
+
+    stats.flows = n_flows;
+    stats.fairness = upper_fairness(0, n_flows);
+    stats.fairness_back = duplex ? upper_fairness(n_flows, n_flows) : -1;
+    stats_report(stdout, main_time, tot_chars_delivered);
+    if (stats_path!=NULL) {
+	FILE *f = fopen(stats_path, "w");
+	if (f==NULL) {
+	    perror(stats_path);
+	    exit(-1);
+	}
+	stats_report_json(f, main_time, tot_chars_sent, tot_chars_delivered);
+	fclose(f);
+    }
 
     return 0;
 }
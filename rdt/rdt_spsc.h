@@ -0,0 +1,69 @@
+/*
+ * FILE: rdt_spsc.h
+ * DESCRIPTION: The header file for a lock-free single-producer,
+ *     single-consumer queue, used to hand items from one thread to
+ *     another without taking a lock.
+ * NOTE: The queue is a ring of a power-of-two size.  The producer only
+ *       writes tail and the consumer only writes head, each on a cache
+ *       line of its own; an item is published by the release store of
+ *       tail and consumed by the release store of head.
+ */
+
+
+#ifndef _RDT_SPSC_H_
+#define _RDT_SPSC_H_
+
+#include <stdlib.h>
+
+#include "rdt_struct.h"
+
+#define SPSC_CACHE_LINE 64
+
+template <typename T>
+class SpscQueue
+{
+public:
+    /* a queue that holds at least capacity items */
+    SpscQueue(unsigned int capacity) {
+	size = 1;
+	while (size<capacity+1) size <<= 1;
+	mask = size-1;
+	ring = (T *)malloc(sizeof(T)*size);
+	ASSERT(ring!=NULL);
+	head = tail = 0;
+    }
+
+    ~SpscQueue() { free(ring); }
+
+    /* producer: append an item, returns false if the queue is full */
+    bool push(const T &item) {
+	unsigned int t = tail;
+	unsigned int next = (t+1) & mask;
+	if (next==__atomic_load_n(&head, __ATOMIC_ACQUIRE)) return false;
+	ring[t] = item;
+	__atomic_store_n(&tail, next, __ATOMIC_RELEASE);
+	return true;
+    }
+
+    /* consumer: take the oldest item, returns false if the queue is empty */
+    bool pop(T *item) {
+	unsigned int h = head;
+	if (h==__atomic_load_n(&tail, __ATOMIC_ACQUIRE)) return false;
+	*item = ring[h];
+	__atomic_store_n(&head, (h+1) & mask, __ATOMIC_RELEASE);
+	return true;
+    }
+
+private:
+    T *ring;
+    unsigned int size;
+    unsigned int mask;
+    alignas(SPSC_CACHE_LINE) unsigned int head;     /* written by the consumer */
+    alignas(SPSC_CACHE_LINE) unsigned int tail;     /* written by the producer */
+
+    /* not copyable */
+    SpscQueue(const SpscQueue &);
+    SpscQueue &operator=(const SpscQueue &);
+};
+
+#endif /* _RDT_SPSC_H_ */
@@ -0,0 +1,182 @@
+/*
+ * FILE: rdt_stats.cc
+ * DESCRIPTION: Efficiency statistics of a run
+ */
+
+#include <string.h>
+
+#include "rdt_struct.h"
+#include "rdt_stats.h"
+
+thread_local struct rdt_stats stats;
+
+void hist_init(struct histogram *h)
+{
+    memset(h, 0, sizeof(struct histogram));
+    h->min = ~0ULL;
+}
+
+/* values below HIST_SUB_COUNT are counted exactly, larger ones are
+   bucketed by their exponent and their HIST_SUB_BITS leading bits */
+static unsigned int hist_index(unsigned long long v)
+{
+    if (v < HIST_SUB_COUNT) return v;
+    unsigned int e = 63 - __builtin_clzll(v) - HIST_SUB_BITS + 1;
+    return HIST_SUB_COUNT + (e - 1) * HIST_HALF_COUNT + (v >> e) - HIST_HALF_COUNT;
+}
+
+/* the largest value that falls in bucket idx */
+static unsigned long long hist_highest(unsigned int idx)
+{
+    if (idx < HIST_SUB_COUNT) return idx;
+    unsigned int e = (idx - HIST_SUB_COUNT) / HIST_HALF_COUNT + 1;
+    unsigned long long m = (idx - HIST_SUB_COUNT) % HIST_HALF_COUNT + HIST_HALF_COUNT;
+    return (m << e) + (1ULL << e) - 1;
+}
+
+void hist_record(struct histogram *h, unsigned long long v)
+{
+    ++h->counts[hist_index(v)];
+    ++h->total;
+    if (v < h->min) h->min = v;
+    if (v > h->max) h->max = v;
+}
+
+void hist_merge(struct histogram *into, const struct histogram *from)
+{
+    if (from->total==0) return;
+    for (unsigned int i = 0; i < HIST_SIZE; ++i)
+        into->counts[i] += from->counts[i];
+    into->total += from->total;
+    if (from->min < into->min) into->min = from->min;
+    if (from->max > into->max) into->max = from->max;
+}
+
+unsigned long long hist_quantile(const struct histogram *h, double q)
+{
+    if (h->total==0) return 0;
+    unsigned long long rank = (unsigned long long)(q * h->total + 0.5);
+    if (rank==0) rank = 1;
+    unsigned long long seen = 0;
+    for (unsigned int i = 0; i < HIST_SIZE; ++i) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            unsigned long long v = hist_highest(i);
+            return v < h->max ? v : h->max;
+        }
+    }
+    return h->max;
+}
+
+void stats_init()
+{
+    memset(&stats, 0, sizeof(stats));
+    hist_init(&stats.latency_us);
+    hist_init(&stats.completion_us);
+    hist_init(&stats.drain_us);
+}
+
+void stats_merge(struct rdt_stats *into, const struct rdt_stats *from)
+{
+    into->data_pkts += from->data_pkts;
+    into->retransmits += from->retransmits;
+    into->ack_pkts += from->ack_pkts;
+    into->piggy_acks += from->piggy_acks;
+    into->dup_pkts += from->dup_pkts;
+    into->msgs_sent += from->msgs_sent;
+    into->msgs_delivered += from->msgs_delivered;
+    hist_merge(&into->latency_us, &from->latency_us);
+    hist_merge(&into->completion_us, &from->completion_us);
+    hist_merge(&into->drain_us, &from->drain_us);
+    into->events += from->events;
+}
+
+void stats_report(FILE *out, double elapsed, unsigned long long delivered)
+{
+    unsigned long long wire = (stats.data_pkts + stats.ack_pkts) * RDT_PKTSIZE;
+    const struct histogram *lat = &stats.latency_us;
+    const struct histogram *fct = &stats.completion_us;
+    const struct histogram *drain = &stats.drain_us;
+
+    fprintf(out, "## Efficiency statistics:\n"
+            "\tgoodput is %.1f bytes per second\n"
+            "\t%llu data packets sent: %llu first transmissions, %llu retransmissions (%.2f%%)\n"
+            "\t%llu bare ack packets sent, %.3f per data packet, %llu acks piggybacked on data\n"
+            "\t%llu duplicate packets arrived\n"
+            "\t%.3f bytes on the wire per delivered byte\n"
+            "\tmessage latency p50 %.4fs, p99 %.4fs, p999 %.4fs, max %.4fs over %llu of %llu messages\n",
+            elapsed > 0 ? delivered / elapsed : 0.0,
+            stats.data_pkts, stats.data_pkts - stats.retransmits, stats.retransmits,
+            stats.data_pkts ? stats.retransmits * 100.0 / stats.data_pkts : 0.0,
+            stats.ack_pkts, stats.data_pkts ? stats.ack_pkts * 1.0 / stats.data_pkts : 0.0,
+            stats.piggy_acks, stats.dup_pkts,
+            delivered ? wire * 1.0 / delivered : 0.0,
+            hist_quantile(lat, 0.5) / 1e6, hist_quantile(lat, 0.99) / 1e6,
+            hist_quantile(lat, 0.999) / 1e6, lat->total ? lat->max / 1e6 : 0.0,
+            stats.msgs_delivered, stats.msgs_sent);
+    if (stats.flows>1) {
+        fprintf(out, "\t%u flows, %.1f bytes per second each on average, latency fairness index %.4f",
+                stats.flows, elapsed > 0 ? delivered / elapsed / stats.flows : 0.0,
+                stats.fairness);
+        if (stats.fairness_back>=0)
+            fprintf(out, ", %.4f for the messages sent back", stats.fairness_back);
+        fputc('\n', out);
+    }
+    if (stats.flows>1 && fct->total>0)
+        fprintf(out, "\tflow completion p50 %.4fs, p99 %.4fs, max %.4fs over %llu flows\n",
+                hist_quantile(fct, 0.5) / 1e6, hist_quantile(fct, 0.99) / 1e6,
+                fct->max / 1e6, fct->total);
+    if (drain->total>0)
+        fprintf(out, "\ttail drain p50 %.4fs, max %.4fs over %llu flows\n",
+                hist_quantile(drain, 0.5) / 1e6, drain->max / 1e6, drain->total);
+    if (stats.events>0)
+        fprintf(out, "\t%llu events simulated\n", stats.events);
+    if (stats.cut_short!=NULL)
+        fprintf(out, "\tthe run was cut short by the %s budget\n", stats.cut_short);
+}
+
+void stats_report_json(FILE *out, double elapsed, unsigned long long sent,
+                       unsigned long long delivered)
+{
+    const struct histogram *lat = &stats.latency_us;
+    const struct histogram *fct = &stats.completion_us;
+    const struct histogram *drain = &stats.drain_us;
+
+    fprintf(out, "{\n"
+            "  \"elapsed_s\": %.6f,\n"
+            "  \"flows\": %u,\n"
+            "  \"fairness\": %.6f,\n"
+            "  \"fairness_back\": %.6f,\n"
+            "  \"bytes_sent\": %llu,\n"
+            "  \"bytes_delivered\": %llu,\n"
+            "  \"goodput_Bps\": %.3f,\n"
+            "  \"msgs_sent\": %llu,\n"
+            "  \"msgs_delivered\": %llu,\n"
+            "  \"data_pkts\": %llu,\n"
+            "  \"first_transmissions\": %llu,\n"
+            "  \"retransmissions\": %llu,\n"
+            "  \"ack_pkts\": %llu,\n"
+            "  \"piggybacked_acks\": %llu,\n"
+            "  \"duplicate_pkts\": %llu,\n"
+            "  \"wire_bytes_per_delivered_byte\": %.6f,\n"
+            "  \"latency_us\": {\"min\": %llu, \"p50\": %llu, \"p99\": %llu, "
+            "\"p999\": %llu, \"max\": %llu},\n"
+            "  \"flow_completion_us\": {\"flows\": %llu, \"p50\": %llu, \"p99\": %llu, "
+            "\"max\": %llu},\n"
+            "  \"drain_us\": {\"flows\": %llu, \"p50\": %llu, \"p99\": %llu, \"max\": %llu},\n"
+            "  \"events\": %llu,\n"
+            "  \"cut_short\": %s%s%s\n"
+            "}\n",
+            elapsed, stats.flows, stats.fairness, stats.fairness_back, sent, delivered,
+            elapsed > 0 ? delivered / elapsed : 0.0,
+            stats.msgs_sent, stats.msgs_delivered,
+            stats.data_pkts, stats.data_pkts - stats.retransmits, stats.retransmits,
+            stats.ack_pkts, stats.piggy_acks, stats.dup_pkts,
+            delivered ? (stats.data_pkts + stats.ack_pkts) * (double)RDT_PKTSIZE / delivered : 0.0,
+            lat->total ? lat->min : 0ULL, hist_quantile(lat, 0.5), hist_quantile(lat, 0.99),
+            hist_quantile(lat, 0.999), lat->max,
+            fct->total, hist_quantile(fct, 0.5), hist_quantile(fct, 0.99), fct->max,
+            drain->total, hist_quantile(drain, 0.5), hist_quantile(drain, 0.99), drain->max,
+            stats.events, stats.cut_short ? "\"" : "", stats.cut_short ? stats.cut_short : "null",
+            stats.cut_short ? "\"" : "");
+}
@@ -0,0 +1,71 @@
+/*
+ * FILE: rdt_stats.h
+ * DESCRIPTION: The header file for the efficiency statistics of a run.
+ */
+
+
+#ifndef _RDT_STATS_H_
+#define _RDT_STATS_H_
+
+#include <stdio.h>
+
+/* histogram precision: values are kept within 1/2^(HIST_SUB_BITS-1) of
+   their real value */
+#define HIST_SUB_BITS 7
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_HALF_COUNT (1 << (HIST_SUB_BITS - 1))
+#define HIST_SIZE (HIST_SUB_COUNT + (64 - HIST_SUB_BITS) * HIST_HALF_COUNT)
+
+/* a log-linear (HDR style) histogram of non-negative integers */
+struct histogram {
+    unsigned long long counts[HIST_SIZE];
+    unsigned long long total;
+    unsigned long long min;
+    unsigned long long max;
+};
+
+void hist_init(struct histogram *h);
+void hist_record(struct histogram *h, unsigned long long v);
+
+/* add the values recorded in from to into */
+void hist_merge(struct histogram *into, const struct histogram *from);
+
+/* the value below or at which a fraction q of the recorded values fall */
+unsigned long long hist_quantile(const struct histogram *h, double q);
+
+/* packet and delivery counters, updated by the simulator, the sender and
+   the receiver.  every thread counts into its own copy, which are merged
+   when the threads are done */
+struct rdt_stats {
+    unsigned long long data_pkts;       /* data packets passed down by both sides */
+    unsigned long long retransmits;     /* of which were retransmissions */
+    unsigned long long ack_pkts;        /* bare acks passed down by both sides */
+    unsigned long long piggy_acks;      /* acks that rode on data packets */
+    unsigned long long dup_pkts;        /* packets a side already had */
+    unsigned long long msgs_sent;
+    unsigned long long msgs_delivered;
+    struct histogram latency_us;        /* message delivery latency */
+    struct histogram completion_us;     /* time by which each flow was done */
+    struct histogram drain_us;          /* from the last message of a flow to its completion */
+    unsigned long long events;          /* simulation events processed */
+    const char *cut_short;              /* the budget that ended the run early, or NULL */
+    unsigned int flows;
+    double fairness;                    /* Jain's index of per-flow message latency */
+    double fairness_back;               /* the same for messages sent back, <0 if none */
+};
+
+extern thread_local struct rdt_stats stats;
+
+void stats_init();
+
+/* add the counters of from to into */
+void stats_merge(struct rdt_stats *into, const struct rdt_stats *from);
+
+/* print the report of a run that lasted elapsed seconds, in which
+   delivered bytes came out of the receiver.  the JSON report also tells
+   the sent bytes passed to the sender */
+void stats_report(FILE *out, double elapsed, unsigned long long delivered);
+void stats_report_json(FILE *out, double elapsed, unsigned long long sent,
+                       unsigned long long delivered);
+
+#endif /* _RDT_STATS_H_ */
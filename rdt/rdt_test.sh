@@ -0,0 +1,154 @@
+#!/bin/sh
+#
+# FILE: rdt_test.sh
+# DESCRIPTION: Regression tests of rdt_sim.  Runs seeded scenarios over
+#     links of increasing trouble, checks that each session is error-free,
+#     loss-free and in order, and compares its efficiency with a baseline.
+#     rdt_udp gets a short smoke run as well.
+# NOTE: The baseline holds a line per scenario:
+#
+#       <name> <wire bytes per delivered byte> <completion time (s)>
+#
+#       wire bytes per delivered byte counts every data and ack packet at
+#       its full size.  completion time is how long the run went on after
+#       the last message arrived, which grows both when the protocol falls
+#       behind the arrivals and when it is slow to drain at the end.  A
+#       scenario fails when either grows by more than the threshold (in
+#       percent, default 5) over the baseline.  Runs with a seed and one
+#       thread are deterministic, so the numbers only move when the
+#       protocol does.
+#
+#       usage: rdt_test.sh [-u] [-t <threshold>] <rdt_sim> <baseline>
+#
+#       -u rewrites the baseline from the current results instead.
+#       rdt_linkgen and rdt_udp are taken from the directory of rdt_sim.
+#
+
+update=0
+threshold=5
+while getopts "ut:" opt; do
+    case $opt in
+    u) update=1 ;;
+    t) threshold=$OPTARG ;;
+    *) exit 2 ;;
+    esac
+done
+shift $((OPTIND-1))
+if [ $# -ne 2 ]; then
+    echo "usage: $0 [-u] [-t <threshold>] <rdt_sim> <baseline>" >&2
+    exit 2
+fi
+sim=$1
+baseline=$2
+
+# every scenario runs for sim_time seconds with a message of 100 bytes
+# on average every 0.1 seconds.  a scenario with link "trace" replays
+# the link trace made below instead of drawing from its rates
+sim_time=100
+scenarios="
+# name      seed  flows  duplex  outoforder  loss  corrupt  link
+clean       1     1      0       0           0     0        random
+loss10      2     1      0       0           0.1   0        random
+loss30      3     1      0       0           0.3   0        random
+loss50      4     1      0       0           0.5   0        random
+corrupt     5     1      0       0           0     0.3      random
+reorder     6     1      0       0.5         0     0        random
+mixed       7     8      1       0.15        0.15  0.15     random
+trace       8     40     0       0           0     0        trace
+"
+
+tmp=$(mktemp -d) || exit 2
+trap 'rm -rf "$tmp"' EXIT
+
+# a trace long enough for the replay to release pages and to wrap around
+if ! "$(dirname "$sim")/rdt_linkgen" -s 1 80000 50000 0.15 0.15 0.15 "$tmp/link.trace"; then
+    echo "FAIL cannot make a link trace"
+    exit 1
+fi
+
+# the number following "key": in a stats JSON file
+json_number() {
+    sed -n "s/.*\"$2\": *\([0-9.eE+-]*\).*/\1/p" "$1" | head -n 1
+}
+
+echo "$scenarios" | while read -r name seed flows duplex outoforder loss corrupt link; do
+    case $name in ""|"#"*) continue ;; esac
+
+    opts="-s $seed -f $flows"
+    [ "$duplex" -eq 1 ] && opts="$opts -d"
+    [ "$link" = trace ] && opts="$opts -t $tmp/link.trace"
+    if ! echo | "$sim" $opts -j "$tmp/$name.json" \
+            $sim_time 0.1 100 $outoforder $loss $corrupt 0 > "$tmp/$name.out" 2>&1; then
+        echo "FAIL $name: rdt_sim exited with an error"
+        echo 1 > "$tmp/failed"
+        continue
+    fi
+    if ! grep -q "Congratulations" "$tmp/$name.out"; then
+        echo "FAIL $name: the session is not error-free, loss-free and in order"
+        echo 1 > "$tmp/failed"
+        continue
+    fi
+
+    wire=$(json_number "$tmp/$name.json" wire_bytes_per_delivered_byte)
+    elapsed=$(json_number "$tmp/$name.json" elapsed_s | awk -v t=$sim_time '{ printf "%.6f", $1 - t }')
+    echo "$name $wire $elapsed" >> "$tmp/results"
+    [ $update -eq 1 ] && continue
+
+    base=$(grep "^$name " "$baseline" 2>/dev/null)
+    if [ -z "$base" ]; then
+        echo "FAIL $name: no baseline"
+        echo 1 > "$tmp/failed"
+        continue
+    fi
+    verdict=$(echo "$base" | awk -v wire="$wire" -v elapsed="$elapsed" -v t="$threshold" '{
+        limit = 1 + t / 100;
+        msg = "";
+        if (wire > $2 * limit)
+            msg = msg sprintf(" wire bytes per delivered byte %.4f > %.4f", wire, $2);
+        if (elapsed > $3 * limit)
+            msg = msg sprintf(" completion time %.3fs > %.3fs", elapsed, $3);
+        print msg;
+    }')
+    if [ -n "$verdict" ]; then
+        echo "FAIL $name:$verdict"
+        echo 1 > "$tmp/failed"
+    else
+        printf "ok   %-8s wire %.4f (%.4f)  completion %.3fs (%.3fs)\n" \
+            "$name" "$wire" "$(echo "$base" | cut -d' ' -f2)" \
+            "$elapsed" "$(echo "$base" | cut -d' ' -f3)"
+    fi
+done
+
+# smoke runs of the UDP loopback transport, over a clean shim and an
+# impaired one.  they run in wall-clock time, so only correctness is
+# checked
+udp_runs="
+# name      duplex  latency  outoforder  loss  corrupt
+udp_clean   0       0        0           0     0
+udp_shim    1       0.01     0.15        0.15  0.15
+"
+[ $update -eq 1 ] || echo "$udp_runs" | while read -r name duplex latency outoforder loss corrupt; do
+    case $name in ""|"#"*) continue ;; esac
+
+    opts="-s 1 -f 4 -l $latency"
+    [ "$duplex" -eq 1 ] && opts="$opts -d"
+    if ! echo | "$(dirname "$sim")/rdt_udp" $opts \
+            2 0.05 100 $outoforder $loss $corrupt 0 > "$tmp/$name.out" 2>&1; then
+        echo "FAIL $name: rdt_udp exited with an error"
+        echo 1 > "$tmp/failed"
+    elif ! grep -q "Congratulations" "$tmp/$name.out"; then
+        echo "FAIL $name: the session is not error-free, loss-free and in order"
+        echo 1 > "$tmp/failed"
+    else
+        echo "ok   $name"
+    fi
+done
+
+if [ -f "$tmp/failed" ]; then
+    exit 1
+fi
+if [ $update -eq 1 ]; then
+    cp "$tmp/results" "$baseline"
+    echo "baseline written to $baseline"
+fi
+exit 0
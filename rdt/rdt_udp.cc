@@ -0,0 +1,805 @@
+/*
+ * FILE: rdt_udp.cc
+ * DESCRIPTION: UDP transport for reliable data transfer.  Runs the sender
+ *     and the receiver of rdt_sim over two UDP sockets on the loopback
+ *     interface, driven by an epoll loop with timerfd timers, so that the
+ *     protocol can be measured in wall-clock time.  A netem-style shim in
+ *     front of each socket drops, corrupts, delays and reorders packets.
+ *     Packets are queued by both sides while the events of an epoll round
+ *     are handled, and sent with one sendmmsg() per socket at the end of
+ *     the round; they are received with recvmmsg() in batches.  The
+ *     timers of both sides and the message arrivals of all flows are kept
+ *     in one event chain in front of a single timerfd.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <queue>
+#include <vector>
+
+#include "rdt_struct.h"
+#include "rdt_event.h"
+#include "rdt_sender.h"
+#include "rdt_receiver.h"
+#include "rdt_evtrace.h"
+#include "rdt_stats.h"
+#include "rdt_upper.h"
+
+
+/*[]------------------------------------------------------------------------[]
+  |  gloabal variables, statistics, etc.
+  []------------------------------------------------------------------------[]*/
+
+/* the upper layer at the sender stops generating messages after this time
+   (in seconds) */
+double run_time;
+
+/* average intervals between consecutive messages passed from the upper layer
+   at the sender (in seconds) */
+double msg_arrivalint;
+
+/* average size of messages (in bytes) */
+int msg_size;
+
+/* one-way packet delivery latency added by the shim, 0 by default */
+double pkt_latency = 0;
+
+/* shim impairments, see rdt_sim */
+double outoforder_rate;
+double loss_rate;
+double corrupt_rate;
+
+/* tracing levels: 1 records events with -b, 2 also prints out the
+   delivered message in hex */
+int tracing_level;
+
+/* number of flows multiplexed over the sockets */
+unsigned int n_flows = 1;
+
+/* whether the receiver sends messages back to the sender as well */
+bool duplex = false;
+
+/* how long to wait for outstanding data after run_time (in seconds) */
+const double drain_limit = 10.0;
+
+/* the epoll instance and the descriptors it watches */
+int epoll_fd;
+int sender_fd, receiver_fd;
+int flow_timer_fd, shim_timer_fd;
+
+struct timespec start_ts;
+
+/* per-flow timer events of either side, ordered by their due time in 
+   wall-clock seconds */
+enum {TIMER_TIMEOUT=0, TIMER_MSG_ARRIVAL};
+enum {SIDE_SENDER=0, SIDE_RECEIVER};
+
+class FlowTimer : public Event
+{
+public:
+    int side;
+    unsigned int flow;
+
+public:
+    FlowTimer(int type, int s, unsigned int f) { event_type = type; side = s; flow = f; }
+};
+
+EventChain flow_timers;
+std::vector<FlowTimer *> timers[2];
+
+/* due time flow_timer_fd is armed for, negative if disarmed */
+double flow_timer_due = -1;
+
+/* message arrivals still going on, over both sides of all flows */
+unsigned int generating_flows = 0;
+
+/* general statistics */
+unsigned long long tot_pkts_passed = 0;
+unsigned long long tot_send_drops = 0;
+
+/* system call counters */
+unsigned long long n_send_calls = 0;
+unsigned long long n_recv_calls = 0;
+unsigned long long n_wait_calls = 0;
+unsigned long long n_timer_calls = 0;
+
+/* packets sent or received with one system call */
+#define IO_BATCH 64
+
+/* packets waiting to go out on a socket with one sendmmsg() */
+struct tx_batch {
+    int fd;
+    int n;
+    struct mmsghdr msgs[IO_BATCH];
+    struct iovec iov[IO_BATCH];
+    struct packet copies[IO_BATCH];     /* the packets, the caller may reuse its own */
+};
+
+/* the slots recvmmsg() fills, the rdt layer reads packets in place */
+struct rx_ring {
+    struct mmsghdr msgs[IO_BATCH];
+    struct iovec iov[IO_BATCH];
+    struct packet slots[IO_BATCH];
+};
+
+struct tx_batch sender_tx, receiver_tx;
+struct rx_ring sender_rx, receiver_rx;
+
+/* a packet held back by the shim */
+struct delayed_packet {
+    double due;
+    unsigned long long order;   /* keeps packets due together in order */
+    struct tx_batch *tx;
+    struct packet pkt;
+};
+
+struct later_due {
+    bool operator()(const delayed_packet &a, const delayed_packet &b) const {
+	return a.due>b.due || (a.due==b.due && a.order>b.order);
+    }
+};
+
+std::priority_queue<delayed_packet, std::vector<delayed_packet>, later_due> shim_queue;
+unsigned long long shim_order = 0;
+
+
+/*[]------------------------------------------------------------------------[]
+  |  transport routines
+  []------------------------------------------------------------------------[]*/
+
+/* generate a random number in [0,1] */
+static double myrandom()
+{
+    return(rand()*1.0/RAND_MAX);
+}
+
+/* get the time since the start of the transfer (in seconds) */
+double GetSimulationTime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec-start_ts.tv_sec) + (ts.tv_nsec-start_ts.tv_nsec)/1e9;
+}
+
+/* arm a timerfd to expire after delay seconds */
+static void arm_timer(int fd, double delay)
+{
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (delay<1e-9) delay = 1e-9;  /* a zero value would disarm it */
+    its.it_value.tv_sec = (time_t)delay;
+    its.it_value.tv_nsec = (long)((delay-its.it_value.tv_sec)*1e9);
+    timerfd_settime(fd, 0, &its, NULL);
+    n_timer_calls ++;
+}
+
+static void disarm_timer(int fd)
+{
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    timerfd_settime(fd, 0, &its, NULL);
+    n_timer_calls ++;
+}
+
+/* consume the expirations of a timerfd, returns false if it has not
+   expired since it was last armed */
+static bool timer_expired(int fd)
+{
+    unsigned long long n;
+    n_recv_calls ++;
+    return read(fd, &n, sizeof(n))==sizeof(n);
+}
+
+/* arm flow_timer_fd for the earliest flow timer, it is only reprogrammed
+   when the earliest due time changes */
+static void rearm_flow_timer()
+{
+    Event *e = flow_timers.peek();
+    double due = e==NULL ? -1 : e->sched_time;
+    if (due==flow_timer_due) return;
+
+    flow_timer_due = due;
+    if (e==NULL)
+	disarm_timer(flow_timer_fd);
+    else
+	arm_timer(flow_timer_fd, due-GetSimulationTime());
+}
+
+/* start the timer of a side of a flow, replacing the one that is set */
+static void start_timer(int side, unsigned int flow, double timeout)
+{
+    double now = GetSimulationTime();
+    evtrace(now, EV_TIMER_START, side, flow, (unsigned int)(timeout*1000000.0), 0, 0);
+
+    FlowTimer *e = timers[side][flow];
+    if (e!=NULL)
+	flow_timers.cancel(e);
+    else
+	e = timers[side][flow] = new FlowTimer(TIMER_TIMEOUT, side, flow);
+    e->sched_time = now+timeout;
+    flow_timers.schedule(e);
+}
+
+/* stop the timer of a side of a flow */
+static void stop_timer(int side, unsigned int flow)
+{
+    evtrace(GetSimulationTime(), EV_TIMER_STOP, side, flow, 0, 0, 0);
+    if (timers[side][flow]!=NULL) {
+	flow_timers.cancel(timers[side][flow]);
+	delete timers[side][flow];
+	timers[side][flow] = NULL;
+    }
+}
+
+/* start the sender timer of a flow with a specified timeout (in seconds) */
+void Sender_StartTimer(unsigned int flow, double timeout)
+{
+    start_timer(SIDE_SENDER, flow, timeout);
+}
+
+/* stop the sender timer of a flow */
+void Sender_StopTimer(unsigned int flow)
+{
+    stop_timer(SIDE_SENDER, flow);
+}
+
+/* check whether the sender timer of a flow is being set */
+bool Sender_isTimerSet(unsigned int flow)
+{
+    return timers[SIDE_SENDER][flow]!=NULL;
+}
+
+/* the receiver timer works the same way */
+void Receiver_StartTimer(unsigned int flow, double timeout)
+{
+    start_timer(SIDE_RECEIVER, flow, timeout);
+}
+
+void Receiver_StopTimer(unsigned int flow)
+{
+    stop_timer(SIDE_RECEIVER, flow);
+}
+
+bool Receiver_isTimerSet(unsigned int flow)
+{
+    return timers[SIDE_RECEIVER][flow]!=NULL;
+}
+
+static void tx_init(struct tx_batch *tx, int fd)
+{
+    memset(tx, 0, sizeof(struct tx_batch));
+    tx->fd = fd;
+    for (int i=0; i<IO_BATCH; i++) {
+	tx->iov[i].iov_base = tx->copies[i].data;
+	tx->iov[i].iov_len = RDT_PKTSIZE;
+	tx->msgs[i].msg_hdr.msg_iov = &tx->iov[i];
+	tx->msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+}
+
+/* put the queued packets on the wire */
+static void tx_flush(struct tx_batch *tx)
+{
+    if (tx->n==0) return;
+
+    n_send_calls ++;
+    int sent = sendmmsg(tx->fd, tx->msgs, tx->n, 0);
+    if (sent<0) sent = 0;
+    /* the socket buffer is full, the rest is lost like on a real link */
+    tot_send_drops += tx->n-sent;
+    tot_pkts_passed += sent;
+    tx->n = 0;
+}
+
+/* queue a copy of a packet to be sent with the next tx_flush(), as the
+   rdt layer frees or rewrites its packets (acks are patched in place)
+   before the round ends */
+static void tx_add(struct tx_batch *tx, struct packet *pkt)
+{
+    if (tx->n==IO_BATCH) tx_flush(tx);
+
+    memcpy(tx->copies[tx->n].data, pkt->data, RDT_PKTSIZE);
+    tx->n ++;
+}
+
+static void rx_init(struct rx_ring *rx)
+{
+    memset(rx, 0, sizeof(struct rx_ring));
+    for (int i=0; i<IO_BATCH; i++) {
+	rx->iov[i].iov_base = rx->slots[i].data;
+	rx->iov[i].iov_len = RDT_PKTSIZE;
+	rx->msgs[i].msg_hdr.msg_iov = &rx->iov[i];
+	rx->msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+}
+
+/* pass a packet through the shim: it is lost, corrupted, delayed and
+   reordered at the configured rates before it is queued on tx */
+static void shim_send(struct tx_batch *tx, struct packet *pkt)
+{
+    /* packet lost at rate "loss_rate" */
+    if (myrandom()<loss_rate) return;
+
+    bool corrupt = myrandom()<corrupt_rate;
+    double latency = pkt_latency;
+    if (myrandom()<outoforder_rate)
+	latency = pkt_latency*2.0*myrandom();
+
+    if (!corrupt && latency<=0) {
+	tx_add(tx, pkt);
+	return;
+    }
+
+    delayed_packet d;
+    d.due = GetSimulationTime() + latency;
+    d.order = shim_order ++;
+    d.tx = tx;
+    memcpy(d.pkt.data, pkt->data, RDT_PKTSIZE);
+    if (corrupt) {
+	for (int i=0; i<RDT_PKTSIZE; i++) {
+	    d.pkt.data[i] = d.pkt.data[i] + (char)(myrandom()*20) - 10;
+	}
+    }
+    if (latency<=0) {
+	tx_add(tx, &d.pkt);
+	return;
+    }
+
+    if (shim_queue.empty() || d.due<shim_queue.top().due)
+	arm_timer(shim_timer_fd, latency);
+    shim_queue.push(d);
+}
+
+/* pass a packet to the lower layer at the sender */
+void Sender_ToLowerLayer(struct packet *pkt)
+{
+    Sender_ToLowerLayerBatch(&pkt, 1);
+}
+
+/* pass n packets to the lower layer at the sender, they are copied and
+   sent together with everything else queued in this round */
+void Sender_ToLowerLayerBatch(struct packet **pkts, int n)
+{
+    for (int i=0; i<n; i++) {
+	shim_send(&sender_tx, pkts[i]);
+    }
+}
+
+/* pass a packet to the lower layer at the receiver, likewise */
+void Receiver_ToLowerLayer(struct packet *pkt)
+{
+    shim_send(&receiver_tx, pkt);
+}
+
+/* the payload stream a side of a flow sends */
+static unsigned int stream_of(int side, unsigned int flow)
+{
+    return side==SIDE_SENDER ? flow : n_flows+flow;
+}
+
+/* deliver a message of a side of a flow to the upper layer at the other side */
+static void deliver_msg(int side, unsigned int flow, struct message *msg)
+{
+    if (tracing_level>=2) {
+	for (int i=0; i<msg->size; i++)
+	    fprintf(stdout, "%02x", (unsigned char)msg->data[i]);
+	fputc('\n', stdout);
+    }
+
+    upper_deliver(stream_of(side, flow), msg, GetSimulationTime());
+}
+
+/* deliver a message of a flow to the upper layer at the receiver */
+void Receiver_ToUpperLayer(unsigned int flow, struct message *msg)
+{
+    deliver_msg(SIDE_SENDER, flow, msg);
+}
+
+/* deliver a message sent back by the receiver to the upper layer at the 
+   sender */
+void Sender_ToUpperLayer(unsigned int flow, struct message *msg)
+{
+    deliver_msg(SIDE_RECEIVER, flow, msg);
+}
+
+
+/*[]------------------------------------------------------------------------[]
+  |  event handlers
+  []------------------------------------------------------------------------[]*/
+
+/* drain a socket batch by batch, passing every packet to the rdt layer on
+   its side */
+static void on_readable(int fd)
+{
+    struct rx_ring *rx = fd==sender_fd ? &sender_rx : &receiver_rx;
+    for (;;) {
+	n_recv_calls ++;
+	int n = recvmmsg(fd, rx->msgs, IO_BATCH, MSG_DONTWAIT, NULL);
+	if (n<=0) break;
+
+	for (int i=0; i<n; i++) {
+	    if (rx->msgs[i].msg_len!=RDT_PKTSIZE) continue;
+	    if (fd==sender_fd) {
+		evtrace(GetSimulationTime(), EV_SENDER_PACKET, SIDE_SENDER, EVTRACE_NO_FLOW, 0, 0, 0);
+		Sender_FromLowerLayer(&rx->slots[i]);
+	    }
+	    else {
+		evtrace(GetSimulationTime(), EV_RECEIVER_PACKET, SIDE_RECEIVER, EVTRACE_NO_FLOW, 0, 0, 0);
+		Receiver_FromLowerLayer(&rx->slots[i]);
+	    }
+	}
+	if (n<IO_BATCH) break;
+    }
+}
+
+/* release the packets the shim held back until now */
+static void on_shim_timer()
+{
+    if (!timer_expired(shim_timer_fd)) return;
+
+    double now = GetSimulationTime();
+    while (!shim_queue.empty() && shim_queue.top().due<=now) {
+	delayed_packet d = shim_queue.top();
+	shim_queue.pop();
+	tx_add(d.tx, &d.pkt);
+    }
+    if (!shim_queue.empty())
+	arm_timer(shim_timer_fd, shim_queue.top().due-now);
+}
+
+/* run the flow timers that are due: pass messages to either side and
+   signal timeouts */
+static void on_flow_timer()
+{
+    if (!timer_expired(flow_timer_fd)) return;
+    flow_timer_due = -1;
+
+    double now = GetSimulationTime();
+    Event *e;
+    while ((e = flow_timers.peek())!=NULL && e->sched_time<=now) {
+	flow_timers.next_event();
+	FlowTimer *t = (FlowTimer *)e;
+
+	int side = t->side;
+	unsigned int flow = t->flow;
+	if (t->event_type==TIMER_TIMEOUT) {
+	    evtrace(now, EV_TIMEOUT, side, flow, 0, 0, 0);
+	    timers[side][flow] = NULL;
+	    delete t;
+	    if (side==SIDE_SENDER)
+		Sender_Timeout(flow);
+	    else
+		Receiver_Timeout(flow);
+	    continue;
+	}
+
+	evtrace(now, EV_UPPER_MESSAGE, side, flow, 0, 0, 0);
+	int size = (int)(myrandom()*2.0*msg_size);
+	if (size==0) size=1;
+	struct message *msg = upper_generate(stream_of(side, flow), size, now);
+	if (side==SIDE_SENDER)
+	    Sender_FromUpperLayer(flow, msg);
+	else
+	    Receiver_FromUpperLayer(flow, msg);
+	upper_free(msg);
+
+	if (t->sched_time<run_time) {
+	    t->sched_time += msg_arrivalint*2.0*myrandom();
+	    flow_timers.schedule(t);
+	}
+	else {
+	    delete t;
+	    generating_flows --;
+	    if (side==SIDE_SENDER)
+		Sender_Drain(flow);
+	    else
+		Receiver_Drain(flow);
+	}
+    }
+}
+
+
+/*[]------------------------------------------------------------------------[]
+  |  setup
+  []------------------------------------------------------------------------[]*/
+
+/* create a non-blocking UDP socket bound to an ephemeral loopback port */
+static int loopback_socket(struct sockaddr_in *addr)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (fd<0) {
+	perror("socket");
+	exit(-1);
+    }
+    socklen_t len = sizeof(*addr);
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr *)addr, len)<0 ||
+	getsockname(fd, (struct sockaddr *)addr, &len)<0) {
+	perror("bind");
+	exit(-1);
+    }
+    return fd;
+}
+
+static int new_timer()
+{
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (fd<0) {
+	perror("timerfd_create");
+	exit(-1);
+    }
+    return fd;
+}
+
+static void watch(int fd)
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev)<0) {
+	perror("epoll_ctl");
+	exit(-1);
+    }
+}
+
+
+/*[]------------------------------------------------------------------------[]
+  |  main control routine
+  []------------------------------------------------------------------------[]*/
+
+int main(int argc, char *argv[])
+{
+    const char *evtrace_path = NULL;
+    const char *stats_path = NULL;
+    bool seeded = false;
+    unsigned int seed = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "+b:df:j:l:s:")) != -1) {
+	switch (opt) {
+	case 'b':
+	    evtrace_path = optarg;
+	    break;
+	case 'd':
+	    duplex = true;
+	    break;
+	case 'f':
+	    n_flows = strtoul(optarg, NULL, 0);
+	    break;
+	case 'j':
+	    stats_path = optarg;
+	    break;
+	case 'l':
+	    pkt_latency = atof(optarg);
+	    break;
+	case 's':
+	    seed = strtoul(optarg, NULL, 0);
+	    seeded = true;
+	    break;
+	default:
+	    argc = 0;
+	    break;
+	}
+    }
+    if (argc-optind!=7) {
+	fprintf(stderr, "usage: %s [-b <event_trace>] [-d] [-f <flows>] [-j <stats_json>] [-l <latency>] "
+		"[-s <seed>] <run_time> <mean_msg_arrivalint> <mean_msg_size> "
+		"<outoforder_rate> <loss_rate> <corrupt_rate> <tracing_level>\n",
+		argv[0]);
+	exit(-1);
+    }
+    argv += optind-1;
+
+    run_time = atof(argv[1]);
+    if (run_time<=0) {
+	fprintf(stderr, "invalid <run_time>\n");
+	exit(-1);
+    }
+    msg_arrivalint = atof(argv[2]);
+    if (msg_arrivalint<=0) {
+	fprintf(stderr, "invalid <msg_arrivalint>\n");
+	exit(-1);
+    }
+    msg_size = atoi(argv[3]);
+    if (msg_size<=0 || msg_size>INT_MAX/2) {
+	fprintf(stderr, "invalid <msg_size>\n");
+	exit(-1);
+    }
+    outoforder_rate = atof(argv[4]);
+    if (outoforder_rate<0 || outoforder_rate>1) {
+	fprintf(stderr, "invalid <outoforder_rate>\n");
+	exit(-1);
+    }
+    loss_rate = atof(argv[5]);
+    if (loss_rate<0 || loss_rate>1) {
+	fprintf(stderr, "invalid <loss_rate>\n");
+	exit(-1);
+    }
+    corrupt_rate = atof(argv[6]);
+    if (corrupt_rate<0 || corrupt_rate>1) {
+	fprintf(stderr, "invalid <corrupt_rate>\n");
+	exit(-1);
+    }
+    tracing_level = atoi(argv[7]);
+    if (tracing_level<0 || tracing_level>2) {
+	fprintf(stderr, "invalid <tracing_level>\n");
+	exit(-1);
+    }
+    if (pkt_latency<0) {
+	fprintf(stderr, "invalid <latency>\n");
+	exit(-1);
+    }
+    if (n_flows==0) {
+	fprintf(stderr, "invalid <flows>\n");
+	exit(-1);
+    }
+
+    fprintf(stdout, "## Reliable data transfer over UDP with:\n"
+	    "\trun time is %.3f seconds\n"
+	    "\taverage message arrival interval is %.6f seconds\n"
+	    "\taverage message size is %d bytes\n"
+	    "\tshim latency is %.3f seconds\n"
+	    "\taverage out-of-order delivery rate is %.2f%%\n"
+	    "\taverage loss rate is %.2f%%\n"
+	    "\taverage corrupt rate is %.2f%%\n"
+	    "\ttracing level is %d\n",
+	    run_time, msg_arrivalint, msg_size, pkt_latency, outoforder_rate*100.0,
+	    loss_rate*100.0, corrupt_rate*100.0, tracing_level);
+    if (n_flows>1)
+	fprintf(stdout, "\t%u flows, each with the above message arrivals\n", n_flows);
+    if (duplex)
+	fprintf(stdout, "\tthe receiver sends messages back with the same arrivals\n");
+    if (evtrace_path!=NULL && tracing_level>=1) {
+	if (!evtrace_open(evtrace_path)) exit(-1);
+	fprintf(stdout, "\tevents are traced to %s\n", evtrace_path);
+    }
+    if (seeded)
+	fprintf(stdout, "\trandom seed is %u\n", seed);
+
+    srand(seeded ? seed : getpid()+getppid());
+    stats_init();
+    upper_init(((unsigned long long)rand()<<32) ^ rand(), duplex ? 2*n_flows : n_flows);
+    timers[SIDE_SENDER].assign(n_flows, (FlowTimer *)NULL);
+    timers[SIDE_RECEIVER].assign(n_flows, (FlowTimer *)NULL);
+
+    /* a pair of loopback sockets connected to each other */
+    struct sockaddr_in sender_addr, receiver_addr;
+    sender_fd = loopback_socket(&sender_addr);
+    receiver_fd = loopback_socket(&receiver_addr);
+    if (connect(sender_fd, (struct sockaddr *)&receiver_addr, sizeof(receiver_addr))<0 ||
+	connect(receiver_fd, (struct sockaddr *)&sender_addr, sizeof(sender_addr))<0) {
+	perror("connect");
+	exit(-1);
+    }
+
+    tx_init(&sender_tx, sender_fd);
+    tx_init(&receiver_tx, receiver_fd);
+    rx_init(&sender_rx);
+    rx_init(&receiver_rx);
+
+    flow_timer_fd = new_timer();
+    shim_timer_fd = new_timer();
+
+    epoll_fd = epoll_create1(0);
+    if (epoll_fd<0) {
+	perror("epoll_create1");
+	exit(-1);
+    }
+    watch(sender_fd);
+    watch(receiver_fd);
+    watch(flow_timer_fd);
+    watch(shim_timer_fd);
+
+    clock_gettime(CLOCK_MONOTONIC, &start_ts);
+
+    /* intialize the sender and the receiver */
+    Sender_Init(n_flows);
+    Receiver_Init(n_flows);
+
+    /* the first message of every flow arrives right away, at both sides if 
+       data flows both ways */
+    for (int side=SIDE_SENDER; side<=(duplex ? SIDE_RECEIVER : SIDE_SENDER); side++) {
+	for (unsigned int i=0; i<n_flows; i++) {
+	    FlowTimer *t = new FlowTimer(TIMER_MSG_ARRIVAL, side, i);
+	    t->sched_time = 0;
+	    flow_timers.schedule(t);
+	    generating_flows++;
+	}
+    }
+    rearm_flow_timer();
+
+    /* main event loop */
+    struct epoll_event events[8];
+    for (;;) {
+	n_wait_calls ++;
+	int n = epoll_wait(epoll_fd, events, 8, 100);
+	if (n<0 && errno!=EINTR) {
+	    perror("epoll_wait");
+	    exit(-1);
+	}
+
+	for (int i=0; i<n; i++) {
+	    int fd = events[i].data.fd;
+	    if (fd==sender_fd || fd==receiver_fd)
+		on_readable(fd);
+	    else if (fd==shim_timer_fd)
+		on_shim_timer();
+	    else if (fd==flow_timer_fd)
+		on_flow_timer();
+	}
+
+	/* send what the handlers queued up */
+	tx_flush(&sender_tx);
+	tx_flush(&receiver_tx);
+	rearm_flow_timer();
+
+	if (generating_flows==0) {
+	    if (tot_chars_delivered==tot_chars_sent && shim_queue.empty())
+		break;
+	    if (GetSimulationTime()>run_time+drain_limit)
+		break;
+	}
+    }
+    double elapsed = GetSimulationTime();
+
+    /* finalize the sender and the receiver */
+    Sender_Final();
+    Receiver_Final();
+    evtrace_close();
+    while (!flow_timers.empty())
+	delete flow_timers.next_event();
+
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    unsigned long long n_calls = n_send_calls+n_recv_calls+n_wait_calls+n_timer_calls;
+    unsigned long long n_pkts = stats.data_pkts+stats.ack_pkts;
+
+    fprintf(stdout, "\n");
+    fprintf(stdout, "## Transfer completed at time %.2fs with\n"
+	    "\t%llu characters sent\n"
+	    "\t%llu characters delivered\n"
+	    "\t%llu packets passed between the sender and the receiver\n"
+	    "\t%llu packets dropped by full socket buffers\n",
+	    elapsed, tot_chars_sent, tot_chars_delivered, tot_pkts_passed, tot_send_drops);
+    upper_report(stdout);
+    stats.flows = n_flows;
+    stats.fairness = upper_fairness(0, n_flows);
+    stats.fairness_back = duplex ? upper_fairness(n_flows, n_flows) : -1;
+    stats_report(stdout, elapsed, tot_chars_delivered);
+    fprintf(stdout, "## System calls:\n"
+	    "\t%llu sendmmsg, %llu recvmmsg/read, %llu epoll_wait, %llu timerfd_settime\n"
+	    "\t%.2f system calls per packet\n"
+	    "\t%.3fs user and %.3fs system CPU time\n",
+	    n_send_calls, n_recv_calls, n_wait_calls, n_timer_calls,
+	    n_pkts ? n_calls*1.0/n_pkts : 0.0,
+	    ru.ru_utime.tv_sec + ru.ru_utime.tv_usec/1e6,
+	    ru.ru_stime.tv_sec + ru.ru_stime.tv_usec/1e6);
+
+    if (stats_path!=NULL) {
+	FILE *f = fopen(stats_path, "w");
+	if (f==NULL) {
+	    perror(stats_path);
+	    exit(-1);
+	}
+	stats_report_json(f, elapsed, tot_chars_sent, tot_chars_delivered);
+	fclose(f);
+    }
+
+    return 0;
+}
@@ -0,0 +1,186 @@
+/*
+ * FILE: rdt_upper.cc
+ * DESCRIPTION: Upper layer test application: message generation and 
+ *     verification
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include <deque>
+#include <utility>
+#include <vector>
+
+#include "rdt_struct.h"
+#include "rdt_upper.h"
+#include "rdt_payload.h"
+#include "rdt_stats.h"
+
+/* 64-bit so that long runs do not overflow */
+thread_local unsigned long long tot_chars_sent = 0;
+thread_local unsigned long long tot_chars_delivered = 0;
+
+/* the stream of one flow */
+struct upper_flow {
+    unsigned long long chars_sent;
+    unsigned long long chars_delivered;
+
+    /* hashes over all characters sent and delivered */
+    struct stream_hash sent_hash;
+    struct stream_hash delivered_hash;
+
+    /* messages not yet completely delivered: the number of characters sent
+       up to and including each message, and the time it was passed to the
+       sender */
+    std::deque<std::pair<unsigned long long, double> > undelivered_msgs;
+
+    /* latencies of the messages delivered */
+    double latency_sum;
+    unsigned long long latency_count;
+};
+
+static std::vector<upper_flow> upper_flows;
+
+/* error flag set by message verification at the receiver */
+static bool message_verfication_passed = true;
+
+/* where and when verification failed first */
+static unsigned int first_error_flow = 0;
+static unsigned long long first_error_char = 0;
+static double first_error_time = 0;
+static pthread_mutex_t error_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void upper_init(unsigned long long seed, unsigned int flows)
+{
+    tot_chars_sent = 0;
+    tot_chars_delivered = 0;
+    message_verfication_passed = true;
+    payload_init(seed);
+    upper_flows.clear();
+    upper_flows.resize(flows);
+    for (unsigned int i = 0; i < flows; ++i) {
+        upper_flows[i].chars_sent = 0;
+        upper_flows[i].chars_delivered = 0;
+        upper_flows[i].latency_sum = 0;
+        upper_flows[i].latency_count = 0;
+        stream_hash_init(&upper_flows[i].sent_hash);
+        stream_hash_init(&upper_flows[i].delivered_hash);
+    }
+}
+
+struct message *upper_generate(unsigned int flow, int size, double now)
+{
+    upper_flow *f = &upper_flows[flow];
+
+    struct message *msg = (struct message*) malloc(sizeof(struct message));
+    ASSERT(msg!=NULL);
+    msg->size = size;
+    msg->data = (char*) malloc(msg->size);
+    ASSERT(msg->data!=NULL);
+
+    /* the messages are consecutive pieces of the flow's stream */
+    payload_fill(flow, msg->data, f->chars_sent, msg->size);
+    stream_hash_update(&f->sent_hash, msg->data, msg->size);
+
+    f->chars_sent += msg->size;
+    tot_chars_sent += msg->size;
+    f->undelivered_msgs.push_back(std::make_pair(f->chars_sent, now));
+    stats.msgs_sent++;
+
+    return msg;
+}
+
+void upper_free(struct message *msg)
+{
+    if (msg->data!=NULL) free(msg->data);
+    if (msg!=NULL) free(msg);
+}
+
+/* record a verification failure at character pos of a flow */
+static void verification_failed(unsigned int flow, unsigned long long pos, double now)
+{
+    pthread_mutex_lock(&error_lock);
+    if (message_verfication_passed || now<first_error_time) {
+        first_error_flow = flow;
+        first_error_char = pos;
+        first_error_time = now;
+    }
+    message_verfication_passed = false;
+    pthread_mutex_unlock(&error_lock);
+}
+
+void upper_deliver(unsigned int flow, struct message *msg, double now)
+{
+    upper_flow *f = &upper_flows[flow];
+
+    /* more characters delivered than sent */
+    if (msg->size<0 || f->chars_delivered+msg->size>f->chars_sent) {
+        verification_failed(flow, f->chars_sent, now);
+        return;
+    }
+
+    int bad = payload_verify(flow, msg->data, f->chars_delivered, msg->size);
+    if (bad>=0)
+        verification_failed(flow, f->chars_delivered+bad, now);
+    stream_hash_update(&f->delivered_hash, msg->data, msg->size);
+
+    f->chars_delivered += msg->size;
+    tot_chars_delivered += msg->size;
+
+    /* record the latency of the messages this completes */
+    while (!f->undelivered_msgs.empty() &&
+           f->undelivered_msgs.front().first<=f->chars_delivered) {
+        double latency = now - f->undelivered_msgs.front().second;
+        hist_record(&stats.latency_us, (unsigned long long)(latency*1000000.0));
+        stats.msgs_delivered++;
+        f->latency_sum += latency;
+        f->latency_count++;
+        f->undelivered_msgs.pop_front();
+    }
+}
+
+bool upper_drained(unsigned int flow)
+{
+    return upper_flows[flow].chars_delivered==upper_flows[flow].chars_sent;
+}
+
+bool upper_passed()
+{
+    if (!message_verfication_passed) return false;
+    for (unsigned int i = 0; i < upper_flows.size(); ++i) {
+        upper_flow *f = &upper_flows[i];
+        if (f->chars_sent!=f->chars_delivered ||
+            stream_hash_final(&f->sent_hash)!=stream_hash_final(&f->delivered_hash))
+            return false;
+    }
+    return true;
+}
+
+double upper_fairness(unsigned int first, unsigned int count)
+{
+    double sum = 0, sum_sq = 0;
+    unsigned int n = 0;
+    for (unsigned int i = first; i < first+count && i < upper_flows.size(); ++i) {
+        const upper_flow *f = &upper_flows[i];
+        if (f->latency_count==0 || f->latency_sum<=0) continue;
+        double x = f->latency_count / f->latency_sum;
+        sum += x;
+        sum_sq += x*x;
+        n++;
+    }
+    if (n==0) return 1.0;
+    return sum*sum / (n*sum_sq);
+}
+
+void upper_report(FILE *out)
+{
+    if (upper_passed())
+        fprintf(out, "## Congratulations! This session is error-free, loss-free, and in order.\n");
+    else {
+        fprintf(out, "## Something is wrong! This session is NOT error-free, loss-free, and in order.\n");
+        if (!message_verfication_passed)
+            fprintf(out, "## The first bad character is #%llu of flow %u, delivered at time %.2fs.\n",
+                    first_error_char, first_error_flow, first_error_time);
+    }
+}
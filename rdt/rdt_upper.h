@@ -0,0 +1,51 @@
+/*
+ * FILE: rdt_upper.h
+ * DESCRIPTION: The header file for the upper layer test application, 
+ *     shared by the simulator and the UDP transport.  It generates the 
+ *     messages passed to the sender and verifies the ones delivered by 
+ *     the receiver, separately for every flow.  Different flows may be
+ *     worked on by different threads, one flow by a single thread only.
+ */
+
+
+#ifndef _RDT_UPPER_H_
+#define _RDT_UPPER_H_
+
+#include <stdio.h>
+
+#include "rdt_struct.h"
+
+/* characters generated and delivered so far, over all flows the calling
+   thread works on */
+extern thread_local unsigned long long tot_chars_sent;
+extern thread_local unsigned long long tot_chars_delivered;
+
+/* start a session of flows whose payload streams are derived from seed */
+void upper_init(unsigned long long seed, unsigned int flows);
+
+/* generate a message of size characters for a flow, passed to the sender
+   at time now */
+struct message *upper_generate(unsigned int flow, int size, double now);
+
+/* free the space of a message */
+void upper_free(struct message *msg);
+
+/* verify a message of a flow delivered by the receiver at time now */
+void upper_deliver(unsigned int flow, struct message *msg, double now);
+
+/* check whether everything generated for a flow so far was delivered */
+bool upper_drained(unsigned int flow);
+
+/* check whether everything generated was delivered correctly and in order */
+bool upper_passed();
+
+/* Jain's fairness index of how fast count flows from first on were
+   served, a flow's speed being the inverse of its mean message latency.
+   1 when all flows waited alike, flows without a delivered message are
+   left out */
+double upper_fairness(unsigned int first, unsigned int count);
+
+/* print the verdict of the session */
+void upper_report(FILE *out);
+
+#endif /* _RDT_UPPER_H_ */